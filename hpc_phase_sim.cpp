@@ -1,25 +1,44 @@
 // simple_hpc_phases.cpp
 // Minimal HPC phase emulator: memory grow/shrink (commit RSS), CPU burn, sleep.
-// No access patterns, no complex partitioning. Thread-safe metrics.
+// Optional cache, bandwidth and calibration engines. Thread-safe metrics.
 //
 // Build: g++ -O2 -std=c++17 -pthread hpc_phase_sim.cpp -o hpc_phase_sim
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
 #include <csignal>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <fcntl.h>
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
 using namespace std;
 using clk = std::chrono::steady_clock;
 
@@ -54,121 +73,2335 @@ static double parse_duration_seconds(const std::string& s){
     double v = stod(s.substr(0,i));
     string u = s.substr(i); for (auto& c:u) c=tolower(c);
     if (u=="" || u=="s") return v;
+    if (u=="us") return v/1e6;
     if (u=="ms") return v/1000.0;
     if (u=="m") return v*60.0;
     if (u=="h") return v*3600.0;
     throw runtime_error("Unknown duration unit in: "+s);
 }
 
-static uint64_t read_vm_rss_kib(){
-    ifstream f("/proc/self/status");
-    string line;
-    while (getline(f,line)) {
-        if (line.rfind("VmRSS:",0)==0) {
-            istringstream iss(line.substr(6));
-            uint64_t kb=0; string kb_s; iss>>kb>>kb_s; return kb;
+static uint64_t read_status_kib(const char* key){
+    ifstream f("/proc/self/status");
+    string line; size_t n = strlen(key);
+    while (getline(f,line)) {
+        if (line.compare(0, n, key)==0) {
+            istringstream iss(line.substr(n));
+            uint64_t kb=0; string kb_s; iss>>kb>>kb_s; return kb;
+        }
+    }
+    return 0;
+}
+static uint64_t read_vm_rss_kib(){ return read_status_kib("VmRSS:"); }
+
+static string read_first_line(const string& path){
+    ifstream f(path); string s;
+    if (!path.empty()) getline(f, s);
+    return s;
+}
+
+static uint64_t major_faults(){
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)ru.ru_majflt;
+}
+
+static double process_cpu_s(){
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// ---------- NUMA placement ----------
+// numa= on a mem phase sets where later pool allocations land and where
+// worker threads run, until the next numa=. Raw mbind/set_mempolicy syscalls
+// (no libnuma). On a single-node machine, or where the syscalls are refused
+// (seccomp, no CONFIG_NUMA), placement is a logged no-op.
+enum NumaPolicy { NUMA_DEFAULT, NUMA_LOCAL, NUMA_INTERLEAVE, NUMA_BIND };
+static const int kMpolPreferred = 1, kMpolBind = 2, kMpolInterleave = 3;   // <linux/mempolicy.h>
+static const int kMaxNodes = 64;
+
+struct NumaSpec { NumaPolicy policy = NUMA_DEFAULT; uint64_t nodes = 0; };   // nodes: bitmask, 0 = all online
+
+static struct NumaState {
+    NumaSpec spec;             // resolved: nodes never 0 unless policy is default
+    bool active = false;       // more than one node online and policy != default
+    cpu_set_t cpus;            // union of the nodes' CPUs
+    atomic<bool> warned{false};
+    atomic<bool> per_node{false};   // active, for the sampler: only then is numa_maps worth walking
+} g_numa;
+
+static const char* numa_policy_name(NumaPolicy p){
+    switch (p){ case NUMA_LOCAL: return "local"; case NUMA_INTERLEAVE: return "interleave"; case NUMA_BIND: return "bind"; default: return "default"; }
+}
+
+// "0-3,8" (sysfs) or "0-1+4" (phase specs, where ',' separates keys)
+static vector<int> parse_id_list(const string& v){
+    vector<int> out;
+    string item; stringstream ss(v);
+    while (getline(ss, item, v.find('+')!=string::npos ? '+' : ',')){
+        if (item.empty() || item=="\n") continue;
+        size_t d = item.find('-');
+        int a = stoi(item.substr(0, d)), b = d==string::npos ? a : stoi(item.substr(d + 1));
+        for (int i=a;i<=b;++i) out.push_back(i);
+    }
+    return out;
+}
+
+// Without /sys/devices/system/node the kernel has no NUMA: one node 0.
+static uint64_t numa_online_mask(){
+    string s = read_first_line("/sys/devices/system/node/online");
+    if (s.empty()) return 1;
+    uint64_t m = 0;
+    for (int n : parse_id_list(s)) if (n < kMaxNodes) m |= 1ull << n;
+    return m ? m : 1;
+}
+
+static string numa_mask_str(uint64_t m){
+    string s;
+    for (int n=0;n<kMaxNodes;++n) if (m & (1ull<<n)) s += (s.empty() ? "" : "+") + to_string(n);
+    return s;
+}
+
+static void numa_warn(const string& what){
+    if (!g_numa.warned.exchange(true)) cerr << "NUMA: warning: " << what << " failed (" << strerror(errno) << "), placement left to the kernel\n";
+}
+
+static int numa_mpol(){
+    return g_numa.spec.policy==NUMA_BIND ? kMpolBind : g_numa.spec.policy==NUMA_INTERLEAVE ? kMpolInterleave : kMpolPreferred;
+}
+
+static void numa_set(const NumaSpec& req){
+    uint64_t online = numa_online_mask();
+    NumaSpec s = req;
+    if (s.policy==NUMA_LOCAL){
+        // Resolve "local" once, to the node main runs on now, so memory and
+        // workers agree for the rest of the run instead of following migrations.
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) node = 0;
+        s.nodes = 1ull << node;
+    }
+    if (s.policy!=NUMA_DEFAULT && s.nodes==0) s.nodes = online;
+    if (s.nodes & ~online) throw runtime_error("numa: node(s) " + numa_mask_str(s.nodes & ~online) + " not online (online: " + numa_mask_str(online) + ")");
+    g_numa.spec = s;
+    g_numa.active = s.policy!=NUMA_DEFAULT && __builtin_popcountll(online) > 1;
+    CPU_ZERO(&g_numa.cpus);
+    if (g_numa.active)
+        for (int n=0;n<kMaxNodes;++n) if (s.nodes & (1ull<<n))
+            for (int c : parse_id_list(read_first_line("/sys/devices/system/node/node" + to_string(n) + "/cpulist")))
+                if (c < CPU_SETSIZE) CPU_SET(c, &g_numa.cpus);
+    g_numa.per_node.store(g_numa.active, memory_order_release);
+}
+
+// "policy=bind nodes=0+1" (+ " note=single_node_noop" when nothing is applied)
+static void print_numa_policy(ostream& os){
+    const NumaSpec& s = g_numa.spec;
+    os << " policy=" << numa_policy_name(s.policy);
+    if (s.policy!=NUMA_DEFAULT) os << " nodes=" << numa_mask_str(s.nodes);
+    if (s.policy!=NUMA_DEFAULT && !g_numa.active) os << " note=single_node_noop";
+}
+
+// Apply the policy to [p, p+n), migrating any pages already faulted in.
+// mbind wants a page aligned start; pool chunks are mapped aligned, for
+// other callers the partial first page keeps the default policy.
+static void numa_place(uint8_t* p, size_t n){
+    if (!g_numa.active || !p) return;
+    uintptr_t a = ((uintptr_t)p + 4095) & ~(uintptr_t)4095, e = (uintptr_t)p + n;
+    if (e <= a) return;
+    unsigned long mask = (unsigned long)g_numa.spec.nodes;
+    const unsigned long kMpolMfMove = 1 << 1;
+    if (syscall(SYS_mbind, (void*)a, e - a, numa_mpol(), &mask, (unsigned long)kMaxNodes + 1, kMpolMfMove) != 0) numa_warn("mbind");
+}
+
+// Worker threads: run on the policy's nodes and allocate their private data
+// (arenas, churn, cache scratch) under the same policy.
+static void numa_bind_thread(){
+    if (!g_numa.active) return;
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &g_numa.cpus) != 0) numa_warn("sched_setaffinity");
+    unsigned long mask = (unsigned long)g_numa.spec.nodes;
+    if (syscall(SYS_set_mempolicy, numa_mpol(), &mask, (unsigned long)kMaxNodes + 1) != 0) numa_warn("set_mempolicy");
+}
+
+// Resident KiB per node, summed over /proc/self/numa_maps ("N<node>=<pages>").
+static vector<uint64_t> numa_node_kib(){
+    vector<uint64_t> kib;
+    ifstream f("/proc/self/numa_maps");
+    string line;
+    while (getline(f, line)){
+        istringstream iss(line); string tok;
+        vector<pair<int,uint64_t>> pages; uint64_t page_kib = 4;
+        while (iss >> tok){
+            if (tok.size() > 2 && tok[0]=='N' && isdigit((unsigned char)tok[1])){
+                size_t eq = tok.find('=');
+                if (eq!=string::npos) pages.emplace_back(stoi(tok.substr(1, eq - 1)), stoull(tok.substr(eq + 1)));
+            } else if (tok.rfind("kernelpagesize_kB=", 0)==0) page_kib = stoull(tok.substr(18));
+        }
+        for (auto& np : pages){
+            if (np.first >= (int)kib.size()) kib.resize(np.first + 1, 0);
+            kib[np.first] += np.second * page_kib;
+        }
+    }
+    return kib;
+}
+
+static void print_numa_kib(ostream& os, const char* prefix){
+    vector<uint64_t> kib = numa_node_kib();
+    for (size_t n=0;n<kib.size();++n) os << " " << prefix << "N" << n << "_kib=" << kib[n];
+}
+
+// ---------- global memory pool ----------
+// Chunks come from new[] unless a NUMA policy is active; then they are
+// private page-aligned mappings so mbind covers every page, and are unmapped.
+struct PoolFree {
+    size_t map_len = 0;
+    void operator()(uint8_t* p) const { if (map_len) munmap(p, map_len); else delete[] p; }
+};
+using PoolChunk = unique_ptr<uint8_t[], PoolFree>;
+struct Buffer { PoolChunk data; size_t size=0; bool locked=false; };
+struct MemState {
+    vector<Buffer> bufs;
+    atomic<size_t> total{0};   // written under mtx, read lock-free by samplers
+    mutex mtx;
+} g_mem;
+
+static void commit_pages(uint8_t* p, size_t n){
+    // Touch one byte per page to commit RSS
+    if (!p || n==0) return;
+    const size_t stride = 4096;
+    volatile uint8_t sink=0;
+    for (size_t i=0; i<n; i+=stride) { p[i]++; sink ^= p[i]; }
+    (void)sink;
+}
+
+// --lock-memory: committed chunks are mlock()ed so they cannot be swapped out.
+// A chunk that would push a process without CAP_IPC_LOCK past RLIMIT_MEMLOCK, or
+// that mlock refuses, stays unlocked: the first failure is reported, later
+// ones are counted, and the mem phase prints the totals.
+static bool g_lock_memory = false;
+static atomic<size_t> g_locked_bytes{0};
+static atomic<uint64_t> g_lock_failures{0};
+
+static string memlock_limit_str(){
+    rlimit rl{};
+    getrlimit(RLIMIT_MEMLOCK, &rl);
+    return rl.rlim_cur==RLIM_INFINITY ? string("unlimited") : to_string((uint64_t)rl.rlim_cur);
+}
+
+// CAP_IPC_LOCK (bit 14 of CapEff) lifts RLIMIT_MEMLOCK; root in a user
+// namespace or a container may lack it, and a non-root process may hold it.
+static bool has_cap_ipc_lock(){
+    static const bool has = [](){
+        ifstream f("/proc/self/status");
+        string line;
+        while (getline(f, line))
+            if (line.rfind("CapEff:", 0)==0) return ((stoull(line.substr(7), nullptr, 16) >> 14) & 1)!=0;
+        return false;
+    }();
+    return has;
+}
+
+static bool lock_chunk(uint8_t* p, size_t n){
+    if (!g_lock_memory || !p || n==0) return false;
+    rlimit rl{};
+    getrlimit(RLIMIT_MEMLOCK, &rl);
+    size_t have = g_locked_bytes.load();
+    string why;
+    if (rl.rlim_cur!=RLIM_INFINITY && !has_cap_ipc_lock() && have + n > (size_t)rl.rlim_cur) why = "would exceed RLIMIT_MEMLOCK";
+    else if (mlock(p, n)!=0) why = string("mlock: ") + strerror(errno);
+    if (why.empty()){ g_locked_bytes += n; return true; }
+    if (g_lock_failures.fetch_add(1)==0)
+        cerr << "LOCK: warning: " << n << " bytes left unlocked (" << why << "): locked_bytes=" << have
+             << " RLIMIT_MEMLOCK=" << memlock_limit_str() << "\n";
+    return false;
+}
+
+static void unlock_chunk(Buffer& b){
+    if (!b.locked) return;
+    munlock(b.data.get(), b.size);
+    g_locked_bytes -= b.size;
+    b.locked = false;
+}
+
+// Allocate and place n bytes; null on failure.
+static PoolChunk pool_chunk(size_t n){
+    if (!g_numa.active) return PoolChunk(new (nothrow) uint8_t[n]);
+    size_t len = (n + 4095) & ~(size_t)4095;
+    void* m = mmap(nullptr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (m==MAP_FAILED) return PoolChunk();
+    numa_place((uint8_t*)m, len);
+    return PoolChunk((uint8_t*)m, PoolFree{len});
+}
+
+// Pages are committed before taking the lock so background growth never
+// stalls the samplers or other allocators for the duration of the faults.
+static void alloc_add(size_t bytes, size_t chunk = (size_t)256<<20 /*256MiB*/) {
+    size_t remain = bytes;
+    while (remain>0) {
+        size_t this_chunk = std::min(remain, chunk);
+        Buffer b;
+        b.data = pool_chunk(this_chunk);
+        if (!b.data) throw bad_alloc();
+        b.size = this_chunk;
+        commit_pages(b.data.get(), b.size);
+        b.locked = lock_chunk(b.data.get(), b.size);
+        lock_guard<mutex> lk(g_mem.mtx);
+        g_mem.total += b.size;
+        g_mem.bufs.push_back(std::move(b));
+        remain -= this_chunk;
+    }
+}
+
+// Pages the sampled working-set estimator currently holds PROT_NONE (see
+// working-set estimation). Released buffers are unprotected first so the
+// allocator never hands a trapping page to someone else.
+static const int kWssSamples = 256;
+// recent[] keeps the pages of the last two windows after they are disarmed:
+// a fault taken just before the unprotect can reach the handler after
+// page[] is cleared, and must be retried rather than treated as real.
+static struct WssArmed {
+    atomic<uintptr_t> page[kWssSamples];
+    atomic<uint8_t> hit[kWssSamples];
+    atomic<uintptr_t> recent[2*kWssSamples];
+    atomic<unsigned> recent_next{0};
+} g_wss_armed;
+
+static void wss_release(const uint8_t* p, size_t n){
+    for (int i=0;i<kWssSamples;++i){
+        uintptr_t pg = g_wss_armed.page[i].load();
+        if (pg && pg >= (uintptr_t)p && pg < (uintptr_t)p + n){
+            mprotect((void*)pg, 4096, PROT_READ|PROT_WRITE);
+            g_wss_armed.page[i].store(0);
+        }
+    }
+}
+
+static void free_bytes(size_t bytes){
+    lock_guard<mutex> lk(g_mem.mtx);
+    size_t remain = bytes;
+    while (remain>0 && !g_mem.bufs.empty()){
+        Buffer& back = g_mem.bufs.back();
+        wss_release(back.data.get(), back.size);
+        if (back.size <= remain) {
+            remain -= back.size;
+            g_mem.total -= back.size;
+            unlock_chunk(back);
+            g_mem.bufs.pop_back();
+        } else {
+            size_t keep = back.size - remain;
+            PoolChunk smaller = pool_chunk(keep);
+            if (!smaller) throw bad_alloc();
+            memcpy(smaller.get(), back.data.get(), keep);
+            bool relock = back.locked;
+            unlock_chunk(back);
+            back.data.swap(smaller);
+            back.size = keep;
+            back.locked = relock && lock_chunk(back.data.get(), keep);
+            g_mem.total -= remain;
+            remain = 0;
+        }
+    }
+}
+
+// ---------- reserved address space ----------
+// One malloc-style reservation: mapped up front (counted in VmSize and, with
+// overcommit accounting, Committed_AS) but faulted in only as `touch` walks
+// it front to back, from a mem phase or from CPU workers. reserve=0 unmaps.
+static struct Reservation {
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    atomic<size_t> touched{0};   // prefix already faulted in
+} g_resv;
+
+static void resv_set(size_t bytes){
+    if (g_resv.base){ munmap(g_resv.base, g_resv.size); g_resv.base = nullptr; g_resv.size = 0; }
+    g_resv.touched.store(0);
+    if (bytes==0) return;
+    bytes = (bytes + 4095) & ~(size_t)4095;
+    void* m = mmap(nullptr, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (m==MAP_FAILED) throw runtime_error("reserve: mmap of " + to_string(bytes) + " bytes failed");
+    g_resv.base = (uint8_t*)m; g_resv.size = bytes;
+    numa_place(g_resv.base, bytes);
+}
+
+// Claim and fault in the next n bytes (page-rounded); returns bytes touched.
+// Safe from several workers at once: each claims a disjoint range.
+static size_t resv_touch(size_t n){
+    n = (n + 4095) & ~(size_t)4095;
+    size_t off = g_resv.touched.load(), take;
+    do {
+        if (off >= g_resv.size) return 0;
+        take = std::min(n, g_resv.size - off);
+    } while (!g_resv.touched.compare_exchange_weak(off, off + take));
+    for (size_t i=0; i<take; i+=4096) g_resv.base[off + i] = 1;
+    return take;
+}
+
+// ---------- shared memory ----------
+// type=shm: one shmem segment, backed by a memfd (anonymous, gone with the
+// last fd and mapping) or a /dev/shm file (tmpfs: it outlives the process
+// unless unlinked, like a crashed MPI rank's segment). Its pages are charged
+// to the cgroup as shmem rather than anon and count towards emptyDir
+// medium=Memory limits. Growth fallocate()s the next chunk (ENOSPC instead of
+// SIGBUS when tmpfs is full) and maps it; shrink unmaps the tail and
+// truncates, which hands the pages back.
+static struct ShmSegment {
+    int fd = -1;
+    string path;                           // /dev/shm file, empty for memfd
+    bool keep = false;                     // leave the /dev/shm file at exit
+    vector<pair<uint8_t*, size_t>> maps;   // consecutive chunks from offset 0
+    atomic<size_t> total{0};               // written by main, read by samplers
+} g_shm;
+
+static void shm_close(){
+    if (g_shm.fd < 0) return;
+    for (auto& m : g_shm.maps) munmap(m.first, m.second);
+    g_shm.maps.clear();
+    g_shm.total = 0;
+    close(g_shm.fd); g_shm.fd = -1;
+    if (!g_shm.path.empty()){
+        if (g_shm.keep) cerr << "SHM: kept " << g_shm.path << "\n";
+        else unlink(g_shm.path.c_str());
+    }
+    g_shm.path.clear();
+}
+
+static void shm_open_segment(bool devshm, const string& name, bool keep){
+    if (devshm){
+        g_shm.path = "/dev/shm/" + (name.empty() ? "hpc_phase_sim." + to_string(getpid()) : name);
+        // O_EXCL: never truncate (or later unlink) a segment another run kept.
+        g_shm.fd = open(g_shm.path.c_str(), O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0600);
+    } else {
+        g_shm.fd = memfd_create(name.empty() ? "hpc_phase_sim" : name.c_str(), MFD_CLOEXEC);
+    }
+    if (g_shm.fd < 0){
+        string what = devshm ? "open " + g_shm.path : string("memfd_create");
+        string hint = devshm && errno==EEXIST ? " (remove it or pick another name=)" : "";
+        g_shm.path.clear();
+        throw runtime_error("shm: " + what + " failed: " + strerror(errno) + hint);
+    }
+    g_shm.keep = keep;
+}
+
+static void shm_add(size_t bytes, size_t chunk = (size_t)256<<20){
+    size_t remain = (bytes + 4095) & ~(size_t)4095;
+    while (remain > 0){
+        size_t n = std::min(remain, chunk), off = g_shm.total;
+        if (fallocate(g_shm.fd, 0, (off_t)off, (off_t)n) != 0)
+            throw runtime_error("shm: fallocate to " + to_string(off + n) + " bytes failed: " + strerror(errno));
+        void* m = mmap(nullptr, n, PROT_READ|PROT_WRITE, MAP_SHARED, g_shm.fd, (off_t)off);
+        if (m==MAP_FAILED) throw runtime_error("shm: mmap of " + to_string(n) + " bytes failed: " + strerror(errno));
+        numa_place((uint8_t*)m, n);
+        commit_pages((uint8_t*)m, n);
+        g_shm.maps.emplace_back((uint8_t*)m, n);
+        g_shm.total += n;
+        remain -= n;
+    }
+}
+
+static void shm_free(size_t bytes){
+    size_t remain = (bytes + 4095) & ~(size_t)4095;
+    while (remain > 0 && !g_shm.maps.empty()){
+        auto& back = g_shm.maps.back();
+        size_t cut = std::min(remain, back.second);
+        munmap(back.first + back.second - cut, cut);
+        back.second -= cut;
+        g_shm.total -= cut;
+        remain -= cut;
+        if (back.second == 0) g_shm.maps.pop_back();
+    }
+    if (ftruncate(g_shm.fd, (off_t)g_shm.total) != 0)
+        throw runtime_error(string("shm: ftruncate failed: ") + strerror(errno));
+    if (g_shm.total == 0) shm_close();
+}
+
+// ---------- calibration ----------
+// Per-host rates used to turn work/bandwidth targets into time. Measured once
+// (< 1s, fixed sizes, best-of-N) before the first phase and cached in a file
+// keyed by a host fingerprint so later runs start with the same scaling.
+struct Calibration {
+    double ops_per_s_core = 0.0; // spin_kernel iterations per second, one thread
+    double mem_bw_gbs = 0.0;     // single-thread memcpy bandwidth (GB/s, read+write)
+    double faults_per_s = 0.0;   // first-touch page faults per second, one thread
+    bool valid() const { return ops_per_s_core > 0 && mem_bw_gbs > 0 && faults_per_s > 0; }
+} g_calib;
+
+// The dependent FMA-like chain burned by CPU phases; one iteration = one op.
+static inline double spin_kernel(double x, uint64_t iters){
+    for (uint64_t i=0;i<iters;++i) x = x * 1.000001 + 0.999999;
+    return x;
+}
+
+// Hardware and kernel identity only: the hostname is the pod name under
+// Kubernetes, so keying on it would miss the cache on every run.
+static string host_fingerprint(){
+    string id;
+    utsname u{}; if (uname(&u)==0) { id += u.release; id += '|'; id += u.version; id += '|'; id += u.machine; }
+    id += "|cpus=" + to_string(thread::hardware_concurrency());
+    ifstream ci("/proc/cpuinfo"); string line;
+    while (getline(ci,line)) if (line.rfind("model name",0)==0) { id += '|' + line; break; }
+    ifstream mi("/proc/meminfo");
+    while (getline(mi,line)) if (line.rfind("MemTotal:",0)==0) { id += '|' + line; break; }
+    uint64_t h = 1469598103934665603ull; // FNV-1a
+    for (unsigned char c : id) { h ^= c; h *= 1099511628211ull; }
+    ostringstream os; os << hex << setw(16) << setfill('0') << h;
+    return os.str();
+}
+
+static string default_calib_path(const string& fp){
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    string dir = xdg && *xdg ? string(xdg) : (home && *home ? string(home) + "/.cache" : string("/tmp"));
+    return dir + "/hpc_phase_sim-calib-" + fp + ".txt";
+}
+
+static bool load_calibration(const string& path, const string& fp, Calibration& c){
+    ifstream f(path);
+    if (!f) return false;
+    string line, got_fp;
+    Calibration r;
+    while (getline(f,line)){
+        auto eq = line.find('=');
+        if (eq==string::npos) continue;
+        string k = line.substr(0,eq), v = line.substr(eq+1);
+        try {
+            if (k=="fingerprint") got_fp = v;
+            else if (k=="ops_per_s_core") r.ops_per_s_core = stod(v);
+            else if (k=="mem_bw_gbs") r.mem_bw_gbs = stod(v);
+            else if (k=="faults_per_s") r.faults_per_s = stod(v);
+        } catch (const exception&) { return false; }
+    }
+    if (got_fp != fp || !r.valid()) return false;
+    c = r;
+    return true;
+}
+
+static void save_calibration(const string& path, const string& fp, const Calibration& c){
+    // Best effort: pods often run with a read-only $HOME.
+    string tmp = path + ".tmp" + to_string(getpid());
+    {
+        ofstream f(tmp, ios::trunc);
+        if (!f) return;
+        f << setprecision(9)
+          << "fingerprint=" << fp << "\n"
+          << "ops_per_s_core=" << c.ops_per_s_core << "\n"
+          << "mem_bw_gbs=" << c.mem_bw_gbs << "\n"
+          << "faults_per_s=" << c.faults_per_s << "\n";
+        if (!f) { remove(tmp.c_str()); return; }
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) remove(tmp.c_str());
+}
+
+static Calibration measure_calibration(){
+    Calibration c;
+    const int reps = 3;
+    // ops: fixed iteration count, best of N (~50ms each on current x86)
+    const uint64_t iters = (uint64_t)20'000'000;
+    volatile double sink = 1.0;
+    for (int r=0;r<reps;++r){
+        auto t = clk::now();
+        sink = spin_kernel(sink, iters);
+        double dt = chrono::duration<double>(clk::now() - t).count();
+        if (dt > 0) c.ops_per_s_core = std::max(c.ops_per_s_core, (double)iters / dt);
+    }
+    // faults + bandwidth on a private mapping that is unmapped afterwards,
+    // so none of this shows up in RSS during the first phase.
+    const size_t n = (size_t)64<<20;
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (int r=0;r<reps;++r){
+        void* m = mmap(nullptr, 2*n, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (m==MAP_FAILED) break;
+        uint8_t* a = (uint8_t*)m; uint8_t* b = a + n;
+        auto t = clk::now();
+        for (size_t i=0;i<2*n;i+=page) a[i] = (uint8_t)i;
+        double dt = chrono::duration<double>(clk::now() - t).count();
+        if (dt > 0) c.faults_per_s = std::max(c.faults_per_s, (double)(2*n/page) / dt);
+        t = clk::now();
+        memcpy(b, a, n);
+        dt = chrono::duration<double>(clk::now() - t).count();
+        sink = sink + b[n/2];
+        if (dt > 0) c.mem_bw_gbs = std::max(c.mem_bw_gbs, 2.0 * (double)n / dt / 1e9);
+        munmap(m, 2*n);
+    }
+    (void)sink;
+    return c;
+}
+
+// mode: "" (use cache, measure on miss) or "force" (always re-measure).
+static void ensure_calibration(const string& mode, const string& cache_path){
+    string fp = host_fingerprint();
+    string path = cache_path.empty() ? default_calib_path(fp) : cache_path;
+    bool cached = mode!="force" && load_calibration(path, fp, g_calib);
+    if (!cached){
+        auto t = clk::now();
+        g_calib = measure_calibration();
+        double dt = chrono::duration<double>(clk::now() - t).count();
+        if (!g_calib.valid()) throw runtime_error("Calibration failed");
+        save_calibration(path, fp, g_calib);
+        cerr << fixed << setprecision(2) << "CALIB: measured in " << dt << "s\n";
+    }
+    cerr << fixed << setprecision(3)
+         << "[calib] fingerprint=" << fp
+         << " source=" << (cached ? "cache" : "measured")
+         << " ops_per_s_core=" << setprecision(0) << g_calib.ops_per_s_core
+         << " mem_bw_gbs=" << setprecision(2) << g_calib.mem_bw_gbs
+         << " faults_per_s=" << setprecision(0) << g_calib.faults_per_s
+         << " path=" << path << "\n";
+}
+
+// ---------- perf counters ----------
+// Optional per-thread perf_event_open groups (--perf). Hardware set: cycles,
+// instructions, LLC misses, dTLB load misses; if the PMU is not usable
+// (VMs, paranoid settings) fall back to task-clock, page-faults and
+// context-switches. Workers open a group on start and fold their final
+// counts into `retired` on exit; totals = retired + live groups.
+enum PerfMode { PERF_OFF, PERF_HW, PERF_SW };
+static const int kPerfN = 4;
+static PerfMode g_perf_mode = PERF_OFF;
+static const char* const kPerfNamesHw[kPerfN] = {"cycles","instructions","llc_misses","dtlb_misses"};
+static const char* const kPerfNamesSw[kPerfN] = {"task_clock_ns","page_faults","ctx_switches",nullptr};
+static bool g_perf_have[kPerfN] = {false,false,false,false};
+
+struct PerfCounts { double v[kPerfN] = {0,0,0,0}; };
+
+static int perf_open(uint32_t type, uint64_t config, int group_fd, bool exclude_kernel){
+    perf_event_attr a{};
+    a.size = sizeof(a); a.type = type; a.config = config;
+    a.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    a.exclude_kernel = exclude_kernel ? 1 : 0; a.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &a, 0 /*this thread*/, -1, group_fd, 0);
+}
+
+static void perf_event_spec(PerfMode m, int i, uint32_t& type, uint64_t& config){
+    const uint64_t ll  = PERF_COUNT_HW_CACHE_LL   | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const uint64_t tlb = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    if (m==PERF_HW){
+        static const uint32_t t[] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+        const uint64_t c[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, ll, tlb};
+        type = t[i]; config = c[i];
+    } else {
+        static const uint64_t c[] = {PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES, 0};
+        type = PERF_TYPE_SOFTWARE; config = c[i];
+    }
+}
+
+struct PerfGroup {
+    int fds[kPerfN] = {-1,-1,-1,-1};
+    int slot[kPerfN] = {-1,-1,-1,-1};   // position of counter i in the group read
+    int n = 0;
+
+    void open_for_this_thread(){
+        if (g_perf_mode==PERF_OFF) return;
+        bool exk = (g_perf_mode==PERF_HW);
+        for (int i=0;i<kPerfN;++i){
+            if (g_perf_mode==PERF_SW && !kPerfNamesSw[i]) continue;
+            uint32_t type; uint64_t config; perf_event_spec(g_perf_mode, i, type, config);
+            int fd = perf_open(type, config, fds[0], exk);
+            if (fd < 0 && !exk) fd = perf_open(type, config, fds[0], true);
+            if (fd < 0){ if (i==0) return; continue; }
+            fds[i] = fd; slot[i] = n++;
+        }
+    }
+    PerfCounts read_counts() const {
+        PerfCounts c;
+        if (fds[0] < 0) return c;
+        uint64_t buf[3 + kPerfN] = {0};
+        if (read(fds[0], buf, sizeof(buf)) < (ssize_t)(3*sizeof(uint64_t))) return c;
+        double scale = buf[2] ? (double)buf[1] / (double)buf[2] : 1.0;  // multiplexing
+        for (int i=0;i<kPerfN;++i) if (slot[i] >= 0 && slot[i] < (int)buf[0]) c.v[i] = (double)buf[3 + slot[i]] * scale;
+        return c;
+    }
+    void close_all(){ for (int& fd : fds) if (fd >= 0){ close(fd); fd = -1; } n = 0; }
+};
+
+static struct PerfRegistry {
+    mutex mtx;
+    PerfCounts retired;
+    vector<const PerfGroup*> live;
+} g_perf;
+
+// RAII: counts the current thread while in scope.
+struct ThreadPerf {
+    PerfGroup g;
+    ThreadPerf(){
+        if (g_perf_mode==PERF_OFF) return;
+        g.open_for_this_thread();
+        if (g.fds[0] < 0) return;
+        lock_guard<mutex> lk(g_perf.mtx);
+        g_perf.live.push_back(&g);
+    }
+    ~ThreadPerf(){
+        if (g.fds[0] < 0) return;
+        lock_guard<mutex> lk(g_perf.mtx);
+        PerfCounts c = g.read_counts();
+        for (int i=0;i<kPerfN;++i) g_perf.retired.v[i] += c.v[i];
+        g_perf.live.erase(std::remove(g_perf.live.begin(), g_perf.live.end(), &g), g_perf.live.end());
+        g.close_all();
+    }
+};
+
+static PerfCounts perf_totals(){
+    lock_guard<mutex> lk(g_perf.mtx);
+    PerfCounts t = g_perf.retired;
+    for (auto* g : g_perf.live){ PerfCounts c = g->read_counts(); for (int i=0;i<kPerfN;++i) t.v[i] += c.v[i]; }
+    return t;
+}
+
+// Pick HW if a cycles group opens on this thread, else SW, else off.
+static void perf_init(){
+    for (PerfMode m : {PERF_HW, PERF_SW}){
+        g_perf_mode = m;
+        PerfGroup probe; probe.open_for_this_thread();
+        if (probe.fds[0] >= 0){
+            for (int i=0;i<kPerfN;++i) g_perf_have[i] = probe.fds[i] >= 0;
+            probe.close_all();
+            return;
+        }
+    }
+    g_perf_mode = PERF_OFF;
+}
+
+static const char* perf_name(int i){ return g_perf_mode==PERF_HW ? kPerfNamesHw[i] : kPerfNamesSw[i]; }
+
+// " perf_<name>=<delta>..." plus derived IPC for the hardware set.
+static void print_perf_delta(ostream& os, const PerfCounts& a, const PerfCounts& b, const char* prefix){
+    if (g_perf_mode==PERF_OFF) return;
+    for (int i=0;i<kPerfN;++i)
+        if (g_perf_have[i]) os << " " << prefix << perf_name(i) << "=" << (uint64_t)(b.v[i] - a.v[i]);
+    if (g_perf_mode==PERF_HW && g_perf_have[1] && b.v[0] > a.v[0])
+        os << " " << prefix << "ipc=" << fixed << setprecision(3) << (b.v[1] - a.v[1]) / (b.v[0] - a.v[0]);
+}
+
+// ---------- working-set estimation ----------
+// --wss[=T] estimates the memory actually touched in each window of T next to
+// VmRSS (which only says what is resident):
+//   referenced  clear the accessed bits of every page of this process
+//               (/proc/self/clear_refs "1"), wait T, sum Referenced: from
+//               smaps_rollup. Whole process, exact at page granularity, one
+//               page-table walk per window; also ages reclaim LRU state.
+//   sampled     fallback when clear_refs is not writable: protect up to 256
+//               random pages of the committed pool, count which ones fault
+//               within T, scale by alloc_bytes. Covers the pool only.
+enum WssMode { WSS_OFF, WSS_REFERENCED, WSS_SAMPLED };
+static WssMode g_wss_mode = WSS_OFF;
+static atomic<uint64_t> g_wss_kib{0};
+static atomic<bool> g_wss_valid{false};   // first window completed
+
+static const char* wss_mode_name(WssMode m){ return m==WSS_REFERENCED ? "referenced" : m==WSS_SAMPLED ? "sampled" : "off"; }
+
+static bool clear_refs(const char* what){
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) return false;
+    bool ok = write(fd, what, strlen(what)) == (ssize_t)strlen(what);
+    close(fd);
+    return ok;
+}
+
+static uint64_t read_referenced_kib(){
+    ifstream f("/proc/self/smaps_rollup");
+    if (!f) f.open("/proc/self/smaps");   // pre-4.14: sum per-mapping lines
+    string line; uint64_t sum = 0;
+    while (getline(f, line))
+        if (line.rfind("Referenced:", 0)==0) sum += strtoull(line.c_str() + 11, nullptr, 10);
+    return sum;
+}
+
+static void wss_segv(int sig, siginfo_t* si, void*){
+    uintptr_t pg = (uintptr_t)si->si_addr & ~(uintptr_t)4095;
+    for (int i=0;i<kWssSamples;++i){
+        if (g_wss_armed.page[i].load(memory_order_relaxed) == pg){
+            mprotect((void*)pg, 4096, PROT_READ|PROT_WRITE);
+            g_wss_armed.hit[i].store(1, memory_order_relaxed);
+            return;
+        }
+    }
+    for (int i=0;i<2*kWssSamples;++i)
+        if (g_wss_armed.recent[i].load(memory_order_relaxed) == pg) return;   // disarmed meanwhile: retry
+    signal(sig, SIG_DFL);   // a real fault: let it re-trigger and crash
+}
+
+// Resolve "auto" to the best mode this process can use.
+static WssMode wss_init(WssMode want){
+    if (want != WSS_SAMPLED && clear_refs("1")) return WSS_REFERENCED;
+    if (want == WSS_REFERENCED) return WSS_OFF;
+    struct sigaction sa{};
+    sa.sa_sigaction = wss_segv; sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(SIGSEGV, &sa, nullptr)==0 ? WSS_SAMPLED : WSS_OFF;
+}
+
+// Protect up to kWssSamples pages lying wholly inside pool buffers.
+static int wss_arm(mt19937_64& rng){
+    lock_guard<mutex> lk(g_mem.mtx);
+    if (g_mem.total < 4096*4) return 0;
+    uniform_int_distribution<size_t> pick(0, g_mem.total - 1);
+    int n = 0;
+    for (int i=0;i<kWssSamples;++i){
+        size_t off = pick(rng);
+        for (auto& b : g_mem.bufs){
+            if (off >= b.size){ off -= b.size; continue; }
+            uintptr_t lo = ((uintptr_t)b.data.get() + 4095) & ~(uintptr_t)4095;
+            uintptr_t pg = ((uintptr_t)b.data.get() + off) & ~(uintptr_t)4095;
+            if (pg >= lo && pg + 4096 <= (uintptr_t)b.data.get() + b.size){
+                g_wss_armed.hit[n].store(0);
+                g_wss_armed.page[n].store(pg);
+                if (mprotect((void*)pg, 4096, PROT_NONE)==0){
+                    g_wss_armed.recent[g_wss_armed.recent_next.fetch_add(1) % (2*kWssSamples)].store(pg);
+                    ++n;
+                }
+                else g_wss_armed.page[n].store(0);
+            }
+            break;
+        }
+    }
+    return n;
+}
+
+static int wss_disarm(int n){
+    int hits = 0;
+    lock_guard<mutex> lk(g_mem.mtx);
+    for (int i=0;i<n;++i){
+        uintptr_t pg = g_wss_armed.page[i].load();
+        if (pg) mprotect((void*)pg, 4096, PROT_READ|PROT_WRITE);
+        g_wss_armed.page[i].store(0);
+        hits += g_wss_armed.hit[i].load();
+    }
+    return hits;
+}
+
+static void wss_loop(const atomic<bool>& running, double interval_s){
+    mt19937_64 rng(0x5DEECE66Dull);
+    auto next = clk::now();
+    const auto step = chrono::duration_cast<clk::duration>(chrono::duration<double>(interval_s));
+    while (running.load() && !g_stop.load()){
+        int armed = 0;
+        if (g_wss_mode==WSS_REFERENCED) clear_refs("1");
+        else armed = wss_arm(rng);
+        next += step;
+        while (running.load() && !g_stop.load() && clk::now() < next)
+            this_thread::sleep_for(std::min<clk::duration>(chrono::milliseconds(50), next - clk::now()));
+        if (g_wss_mode==WSS_REFERENCED){
+            g_wss_kib.store(read_referenced_kib());
+        } else {
+            int hits = wss_disarm(armed);
+            size_t alloc = g_mem.total.load();
+            g_wss_kib.store(armed ? (uint64_t)((double)hits / armed * alloc / 1024.0) : 0);
+        }
+        g_wss_valid.store(true);
+    }
+}
+
+// ---------- trace export ----------
+// --trace-out=FILE writes Chrome Trace Event Format (JSON array form) for
+// chrome://tracing / Perfetto. Events are appended as they happen under one
+// lock; the array form loads without its closing bracket, so a killed run is
+// still readable. Tracks use stable synthetic tids (main, one per worker
+// slot) so worker 3 of every CPU phase lands on the same row.
+enum TraceTrack { TRACK_MAIN = 1, TRACK_CPU = 1000, TRACK_BW = 100000, TRACK_PIPE = 200000 };
+
+static struct TraceState {
+    mutex mtx;
+    ofstream out;
+    bool on = false;             // set before any thread starts, read-only after
+    clk::time_point t0;
+    long pid = 0;
+    uint64_t events = 0;
+    vector<int> named;           // tids that already have a thread_name record
+} g_trace;
+
+static string json_escape(const string& s){
+    string o; o.reserve(s.size());
+    for (char c : s){
+        if (c=='"' || c=='\\') { o += '\\'; o += c; }
+        else if ((unsigned char)c < 0x20) { char b[8]; snprintf(b, sizeof(b), "\\u%04x", c); o += b; }
+        else o += c;
+    }
+    return o;
+}
+
+// Common prefix of one event; args (if any) is the inside of a JSON object.
+static string trace_event(char ph, int tid, const char* cat, const string& name, clk::time_point t){
+    ostringstream o;
+    o << fixed << setprecision(3)
+      << "{\"ph\":\"" << ph << "\",\"pid\":" << g_trace.pid << ",\"tid\":" << tid
+      << ",\"cat\":\"" << cat << "\",\"name\":\"" << json_escape(name) << "\""
+      << ",\"ts\":" << chrono::duration<double, micro>(t - g_trace.t0).count();
+    return o.str();
+}
+
+static void trace_write(const string& ev, const string& args){
+    lock_guard<mutex> lk(g_trace.mtx);
+    g_trace.out << (g_trace.events++ ? ",\n" : "[\n") << ev;
+    if (!args.empty()) g_trace.out << ",\"args\":{" << args << "}";
+    g_trace.out << "}";
+}
+
+static void trace_thread(int tid, const string& name){
+    if (!g_trace.on) return;
+    {
+        lock_guard<mutex> lk(g_trace.mtx);
+        if (find(g_trace.named.begin(), g_trace.named.end(), tid) != g_trace.named.end()) return;
+        g_trace.named.push_back(tid);
+    }
+    trace_write(trace_event('M', tid, "meta", "thread_name", g_trace.t0), "\"name\":\"" + json_escape(name) + "\"");
+    trace_write(trace_event('M', tid, "meta", "thread_sort_index", g_trace.t0), "\"sort_index\":" + to_string(tid));
+}
+
+static void trace_span(int tid, const char* cat, const string& name, clk::time_point a, clk::time_point b,
+                       const string& args = ""){
+    if (!g_trace.on) return;
+    ostringstream d; d << fixed << setprecision(3) << ",\"dur\":" << chrono::duration<double, micro>(b - a).count();
+    trace_write(trace_event('X', tid, cat, name, a) + d.str(), args);
+}
+
+// scope: 't' thread row, 'p' whole process (drawn across all tracks).
+static void trace_instant(int tid, const char* cat, const string& name, clk::time_point t,
+                          const string& args = "", char scope = 't'){
+    if (!g_trace.on) return;
+    trace_write(trace_event('i', tid, cat, name, t) + ",\"s\":\"" + scope + "\"", args);
+}
+
+static void trace_counter(const string& name, clk::time_point t, const string& args){
+    if (!g_trace.on) return;
+    trace_write(trace_event('C', TRACK_MAIN, "counter", name, t), args);
+}
+
+static void trace_open(const string& path, clk::time_point t0, const string& job_name){
+    g_trace.out.open(path, ios::out | ios::trunc);
+    if (!g_trace.out) throw runtime_error("cannot open trace file: " + path);
+    g_trace.on = true; g_trace.t0 = t0; g_trace.pid = (long)getpid();
+    trace_write(trace_event('M', TRACK_MAIN, "meta", "process_name", t0), "\"name\":\"" + json_escape(job_name) + "\"");
+    trace_thread(TRACK_MAIN, "main");
+}
+
+static void trace_close(){
+    if (!g_trace.on) return;
+    lock_guard<mutex> lk(g_trace.mtx);
+    g_trace.out << "\n]\n";
+    g_trace.out.close();
+    g_trace.on = false;
+}
+
+// cgroup file for this process: v2 unified name, else the v1 controller's
+// file. Tries the path from /proc/self/cgroup, then the mount root (inside
+// a cgroup namespace the two coincide). "" if neither exists.
+static string cgroup_file(const string& v2, const string& v1_ctrl, const string& v1){
+    ifstream f("/proc/self/cgroup");
+    string line, p2, p1, ctrl_dir;
+    while (getline(f, line)){
+        size_t a = line.find(':'), b = line.find(':', a + 1);
+        if (a==string::npos || b==string::npos) continue;
+        string ctrls = line.substr(a + 1, b - a - 1), path = line.substr(b + 1);
+        if (ctrls.empty()) p2 = path;
+        else if (("," + ctrls + ",").find("," + v1_ctrl + ",") != string::npos){ p1 = path; ctrl_dir = ctrls; }
+    }
+    vector<string> cand;
+    if (!v2.empty()) { cand.push_back("/sys/fs/cgroup" + p2 + "/" + v2); cand.push_back("/sys/fs/cgroup/" + v2); }
+    if (!v1.empty() && !ctrl_dir.empty()){
+        for (const string& d : {ctrl_dir, v1_ctrl}){
+            cand.push_back("/sys/fs/cgroup/" + d + p1 + "/" + v1);
+            cand.push_back("/sys/fs/cgroup/" + d + "/" + v1);
+        }
+    }
+    for (auto& c : cand) if (access(c.c_str(), R_OK)==0) return c;
+    return "";
+}
+
+// CFS throttling totals of our cgroup: periods throttled and time throttled.
+static bool read_cpu_throttle(uint64_t& periods, double& throttled_s){
+    static const string path = cgroup_file("cpu.stat", "cpu", "cpu.stat");
+    if (path.empty()) return false;
+    ifstream f(path); string k; uint64_t v; bool got = false;
+    periods = 0; throttled_s = 0;
+    while (f >> k >> v){
+        if (k=="nr_throttled") { periods = v; got = true; }
+        else if (k=="throttled_usec") throttled_s = v * 1e-6;  // v2
+        else if (k=="throttled_time") throttled_s = v * 1e-9;  // v1 (ns)
+    }
+    return got;
+}
+
+// Swap charged to our cgroup: memory.swap.current (v2), or memsw - usage
+// (v1, needs swapaccount=1). -1 when neither is readable.
+static int64_t read_cgroup_swap_bytes(){
+    static const string v2 = cgroup_file("memory.swap.current", "", "");
+    static const string memsw = cgroup_file("", "memory", "memory.memsw.usage_in_bytes");
+    static const string usage = cgroup_file("", "memory", "memory.usage_in_bytes");
+    string s = read_first_line(v2);
+    if (!s.empty()) return (int64_t)stoull(s);
+    string a = read_first_line(memsw), b = read_first_line(usage);
+    if (a.empty() || b.empty()) return -1;
+    return std::max<int64_t>(0, (int64_t)stoull(a) - (int64_t)stoull(b));
+}
+
+// One key of the cgroup's memory.stat (same name on v1 and v2), -1 if absent.
+static int64_t read_cgroup_memory_stat(const string& key){
+    static const string path = cgroup_file("memory.stat", "memory", "memory.stat");
+    if (path.empty()) return -1;
+    ifstream f(path); string k; uint64_t v;
+    while (f >> k >> v) if (k==key) return (int64_t)v;
+    return -1;
+}
+
+// One counter sample per logger tick: alloc/RSS, throttling per interval and
+// a process-wide instant whenever the cgroup CPU or memory limit changes.
+static void trace_sample(clk::time_point now){
+    if (!g_trace.on) return;
+    size_t alloc = g_mem.total.load();
+    trace_counter("alloc_bytes", now, "\"alloc_bytes\":" + to_string(alloc));
+    trace_counter("VmRSS_bytes", now, "\"VmRSS_bytes\":" + to_string(read_vm_rss_kib() * 1024));
+    if (g_wss_valid.load()) trace_counter("wss_bytes", now, "\"wss_bytes\":" + to_string(g_wss_kib.load() * 1024));
+
+    static bool have_last = false;
+    static uint64_t last_periods = 0; static double last_thr_s = 0;
+    uint64_t periods; double thr_s;
+    if (read_cpu_throttle(periods, thr_s)){
+        if (have_last){
+            ostringstream a; a << fixed << setprecision(3)
+                << "\"throttled_periods\":" << (periods - last_periods)
+                << ",\"throttled_ms\":" << (thr_s - last_thr_s) * 1e3;
+            trace_counter("cpu_throttling", now, a.str());
+        }
+        have_last = true; last_periods = periods; last_thr_s = thr_s;
+    }
+
+    static const string cpu_path = cgroup_file("cpu.max", "cpu", "cpu.cfs_quota_us");
+    static const string mem_path = cgroup_file("memory.max", "memory", "memory.limit_in_bytes");
+    static string last_cpu = "\x01", last_mem = "\x01";
+    string cpu = read_first_line(cpu_path), mem = read_first_line(mem_path);
+    if (cpu != last_cpu || mem != last_mem){
+        trace_instant(TRACK_MAIN, "cgroup", "limit_change", now,
+                      "\"cpu\":\"" + json_escape(cpu) + "\",\"memory\":\"" + json_escape(mem) + "\"", 'p');
+        last_cpu = cpu; last_mem = mem;
+    }
+    lock_guard<mutex> lk(g_trace.mtx);
+    g_trace.out.flush();
+}
+
+// ---------- per-thread arenas ----------
+// Bump allocators for worker temporaries and kernel scratch. Each reserves
+// address space once (MAP_NORESERVE); reset() is O(1). Arenas belong to a
+// worker slot and outlive the phase, so RSS they hold persists until the
+// trim policy gives it back with MADV_DONTNEED:
+//   never   keep every page ever touched (app holds its peak)
+//   phase   drop all pages when the CPU phase ends
+//   idle:S  drop pages above the recent step peak once unused for S seconds
+struct TrimPolicy {
+    enum Kind { NEVER, PHASE, IDLE } kind = NEVER;
+    double idle_s = 0.0;
+};
+
+static TrimPolicy parse_trim(const string& v){
+    TrimPolicy t;
+    if (v=="never") t.kind = TrimPolicy::NEVER;
+    else if (v=="phase") t.kind = TrimPolicy::PHASE;
+    else if (v.rfind("idle:",0)==0){ t.kind = TrimPolicy::IDLE; t.idle_s = parse_duration_seconds(v.substr(5)); }
+    else throw runtime_error("Unknown trim policy: "+v);
+    return t;
+}
+
+struct Arena {
+    uint8_t* base = nullptr;
+    size_t reserved = 0, floor = 0, used = 0;
+    size_t committed = 0;                 // page-rounded high-water mark since last trim
+    size_t recent_peak = 0; clk::time_point recent_peak_t = clk::now();
+
+    explicit Arena(size_t reserve) : reserved(reserve) {
+        void* m = mmap(nullptr, reserve, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (m==MAP_FAILED) throw runtime_error("arena: cannot reserve " + to_string(reserve) + " bytes");
+        base = (uint8_t*)m;
+    }
+    ~Arena(){ trim_to(0); munmap(base, reserved); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* alloc(size_t n, size_t align = 64){
+        size_t off = (used + align - 1) & ~(align - 1);
+        if (off + n > reserved) return nullptr;
+        used = off + n;
+        size_t pages = (used + 4095) & ~(size_t)4095;
+        if (pages > committed){ g_arena_committed.fetch_add(pages - committed); committed = pages; }
+        return base + off;
+    }
+    void mark_floor(){ floor = used; }
+    void drop_floor(){ floor = 0; }
+
+    void trim_to(size_t keep){
+        keep = (keep + 4095) & ~(size_t)4095;
+        if (keep >= committed) return;
+        madvise(base + keep, committed - keep, MADV_DONTNEED);
+        g_arena_committed.fetch_sub(committed - keep);
+        committed = keep;
+    }
+
+    // End of a step: forget temporaries above the floor and apply `idle`.
+    void reset(const TrimPolicy& tp, clk::time_point now){
+        size_t step_used = used;
+        used = floor;
+        if (tp.kind!=TrimPolicy::IDLE) return;
+        if (step_used >= recent_peak){ recent_peak = step_used; recent_peak_t = now; }
+        else if (chrono::duration<double>(now - recent_peak_t).count() >= tp.idle_s){
+            trim_to(std::max(step_used, floor));
+            recent_peak = step_used; recent_peak_t = now;
+        }
+    }
+
+    static atomic<uint64_t> g_arena_committed;
+};
+atomic<uint64_t> Arena::g_arena_committed{0};
+
+// Persistent arena per worker slot; re-reserved only when a phase asks for more.
+static mutex g_arenas_mtx;
+static vector<unique_ptr<Arena>> g_arenas;
+
+static Arena& worker_arena(int id, size_t reserve){
+    lock_guard<mutex> lk(g_arenas_mtx);
+    if ((int)g_arenas.size() <= id) g_arenas.resize(id + 1);
+    if (!g_arenas[id] || g_arenas[id]->reserved < reserve) g_arenas[id].reset(new Arena(reserve));
+    return *g_arenas[id];
+}
+
+// ---------- CPU kernels ----------
+// Cache sizes from sysfs (cpu0), falling back to glibc sysconf, then defaults.
+struct CacheInfo { size_t l1d=(size_t)32<<10, l2=(size_t)1<<20, llc=(size_t)32<<20; };
+
+static size_t read_sysfs_size(const string& path){
+    ifstream f(path); string v;
+    if (!(f>>v) || v.empty()) return 0;
+    try { return (size_t)parse_size_bytes(v); } catch (const exception&) { return 0; }
+}
+
+static const CacheInfo& cache_info(){
+    static const CacheInfo ci = [](){
+        CacheInfo c;
+        size_t l1=0, l2=0, llc=0; int llc_level=0;
+        for (int i=0;i<8;++i){
+            string d = "/sys/devices/system/cpu/cpu0/cache/index" + to_string(i) + "/";
+            ifstream lf(d+"level"), tf(d+"type");
+            int level=0; string type;
+            if (!(lf>>level) || !(tf>>type)) break;
+            if (type=="Instruction") continue;
+            size_t sz = read_sysfs_size(d+"size");
+            if (level==1) l1 = sz;
+            if (level==2) l2 = sz;
+            if (level>=llc_level){ llc_level = level; llc = sz; }
+        }
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+        if (!l1) { long v = sysconf(_SC_LEVEL1_DCACHE_SIZE); if (v>0) l1 = (size_t)v; }
+        if (!l2) { long v = sysconf(_SC_LEVEL2_CACHE_SIZE);  if (v>0) l2 = (size_t)v; }
+        if (!llc){ long v = sysconf(_SC_LEVEL3_CACHE_SIZE);  if (v>0) llc = (size_t)v; }
+#endif
+        if (l1) c.l1d = l1;
+        if (l2) c.l2 = l2;
+        c.llc = llc ? llc : std::max(c.l2, c.llc);
+        return c;
+    }();
+    return ci;
+}
+
+// "L1" | "L2" | "L3" | "LLC" | "<f>*<level>" | "<SIZE>"; *llc is set when
+// the size is relative to the shared last-level cache.
+static size_t parse_ws(const string& spec, bool* llc = nullptr){
+    string v = spec; for (auto& c:v) c=toupper(c);
+    double f = 1.0;
+    auto star = v.find('*');
+    if (star!=string::npos){ f = stod(v.substr(0,star)); v = v.substr(star+1); }
+    const CacheInfo& ci = cache_info();
+    double base;
+    if (v=="L1"||v=="L1D") base = (double)ci.l1d;
+    else if (v=="L2") base = (double)ci.l2;
+    else if (v=="L3"||v=="LLC"){ base = (double)ci.llc; if (llc) *llc = true; }
+    else if (star==string::npos) return (size_t)parse_size_bytes(spec);
+    else throw runtime_error("Unknown cache level in ws="+spec);
+    if (f <= 0) throw runtime_error("ws factor must be > 0 in ws="+spec);
+    return (size_t)(f * base);
+}
+
+struct CpuKernel {
+    enum Kind { SPIN, CACHE, CHASE } kind = SPIN;
+    // cache: per-thread working set walked line by line
+    // chase: cap on the committed bytes linked into the cycle (0 = all)
+    size_t ws_bytes = 0;
+    size_t ws_total = 0;      // cache, LLC-relative ws: the phase footprint ws_bytes is split from
+    enum Pattern { THRASH, RESIDENT } pattern = THRASH;
+    // chase
+    enum Layout { GLOBAL, HUGE } layout = GLOBAL;
+    double rate = 0.0;        // dependent loads/s per thread, 0 = as fast as possible
+    // chase access skew over 2 MiB blocks ranked in a fixed random order
+    enum Access { UNIFORM, ZIPF, HOT } access = UNIFORM;
+    double zipf_s = 1.0;      // P(rank r) ~ r^-s
+    double hot_fraction = 0.1, hot_share = 0.9;  // hot_share of loads go to the first hot_fraction of blocks
+};
+
+static const char* kernel_name(CpuKernel::Kind k){
+    switch (k){ case CpuKernel::CACHE: return "cache"; case CpuKernel::CHASE: return "chase"; default: return "spin"; }
+}
+
+// Counters published by workers and turned into per-sample rates by the logger.
+struct LiveCounters {
+    atomic<uint64_t> chase_loads{0}, chase_ns{0};
+    atomic<uint64_t> probe_count{0}, probe_lat_ps{0}, probe_copy_mbs{0};  // sums over probes
+    atomic<uint64_t> churn_live_bytes{0};                                 // gauge
+    atomic<uint64_t> gc_heap_bytes{0};                                    // gauge
+    atomic<uint64_t> pipe_batches{0};                                     // batches through the sink
+    atomic<uint64_t> pipe_inflight_bytes{0};                              // gauge: batches alive in a pipeline
+    atomic<uint64_t> bsp_steps{0}, bsp_eff_ppm{0};                        // supersteps, sum of step efficiencies
+} g_live;
+
+// Keyed bijection on [0,n): 4-round Feistel over the next even bit width,
+// cycle-walked back into range. Lets us link a random cycle without a
+// temporary index array the size of the working set.
+struct FeistelPerm {
+    uint64_t n, half_bits, half_mask; uint64_t keys[4];
+    FeistelPerm(uint64_t n_, uint64_t seed) : n(n_) {
+        uint64_t bits = 1; while ((1ull<<bits) < n) ++bits;
+        half_bits = (bits + 1) / 2; half_mask = (1ull<<half_bits) - 1;
+        for (int i=0;i<4;++i){ seed = seed*6364136223846793005ull + 1442695040888963407ull; keys[i] = seed >> 16; }
+    }
+    uint64_t round_once(uint64_t x) const {
+        uint64_t l = x >> half_bits, r = x & half_mask;
+        for (int i=0;i<4;++i){
+            uint64_t f = (r ^ keys[i]) * 0x9E3779B97F4A7C15ull;
+            f ^= f >> 29;
+            uint64_t nl = r, nr = (l ^ f) & half_mask;
+            l = nl; r = nr;
+        }
+        return (l << half_bits) | r;
+    }
+    uint64_t operator()(uint64_t i) const { do { i = round_once(i); } while (i >= n); return i; }
+};
+
+// State shared by all workers of one CPU phase, built before they start.
+struct KernelShared {
+    vector<vector<uint8_t*>> chase_start;  // [bucket][thread] entry point into the bucket's cycle
+    vector<double> bucket_cdf;             // cumulative load share per bucket
+};
+
+// Link 2 MiB blocks into one random cycle of 64-byte nodes; layout=huge
+// visits every line of a block (random order) before jumping to the next
+// block, so the chase pays cache misses but few TLB misses once THP backs the
+// blocks. layout=global is fully random. Returns per-thread entry points.
+static vector<uint8_t*> link_chase(const vector<uint8_t*>& blocks, CpuKernel::Layout layout, int threads){
+    const size_t L = ((size_t)2<<20) / 64;
+    const uint64_t n = (uint64_t)blocks.size() * L;
+    FeistelPerm gperm(n, 0x243F6A8885A308D3ull), bperm(blocks.size(), 0x13198A2E03707344ull), lperm(L, 0xA4093822299F31D0ull);
+    auto node = [&](uint64_t i) -> uint8_t* {
+        if (layout==CpuKernel::HUGE) return blocks[bperm(i / L)] + lperm(i % L) * 64;
+        uint64_t j = gperm(i);
+        return blocks[j / L] + (j % L) * 64;
+    };
+    uint8_t* first = node(0);
+    uint8_t* prev = first;
+    for (uint64_t i=1;i<n;++i){
+        uint8_t* cur = node(i);
+        *(uint8_t**)prev = cur;
+        prev = cur;
+    }
+    *(uint8_t**)prev = first;
+    vector<uint8_t*> starts;
+    for (int t=0;t<threads;++t) starts.push_back(node((uint64_t)t * n / threads));
+    return starts;
+}
+
+// Chase over the committed memory. With access skew the blocks are shuffled
+// once (rank = position) and split into buckets, each its own cycle; workers
+// pick a bucket per 64 loads by its probability mass. zipf buckets are
+// power-of-two rank ranges [2^j, 2^(j+1)); hot is two buckets.
+static KernelShared prepare_chase(const CpuKernel& k, int threads){
+    const size_t block = (size_t)2<<20;
+    vector<uint8_t*> blocks;
+    {
+        lock_guard<mutex> lk(g_mem.mtx);
+        size_t cap = k.ws_bytes ? k.ws_bytes : SIZE_MAX;
+        for (auto& b : g_mem.bufs){
+            uintptr_t lo = ((uintptr_t)b.data.get() + block - 1) & ~(uintptr_t)(block - 1);
+            uintptr_t hi = ((uintptr_t)b.data.get() + b.size) & ~(uintptr_t)(block - 1);
+            if (hi <= lo) continue;
+            if (k.layout==CpuKernel::HUGE) madvise((void*)lo, hi - lo, MADV_HUGEPAGE);
+            for (uintptr_t a=lo; a<hi && blocks.size()*block < cap; a+=block) blocks.push_back((uint8_t*)a);
+        }
+    }
+    if (blocks.empty()) throw runtime_error("chase kernel needs committed memory (>= 4 MiB in a mem phase)");
+
+    const size_t nb = blocks.size();
+    vector<pair<size_t,size_t>> ranks;  // [lo, hi) block ranks per bucket
+    vector<double> w;
+    if (k.access==CpuKernel::HOT){
+        size_t h = std::min(nb, std::max<size_t>(1, (size_t)ceil(k.hot_fraction * nb)));
+        ranks.push_back({0, h}); w.push_back(k.hot_share);
+        if (h < nb){ ranks.push_back({h, nb}); w.push_back(1.0 - k.hot_share); }
+    } else if (k.access==CpuKernel::ZIPF){
+        for (size_t lo=0; lo<nb; lo=2*lo+1){
+            size_t hi = std::min(nb, 2*lo+1);
+            double m = 0; for (size_t r=lo+1; r<=hi; ++r) m += pow((double)r, -k.zipf_s);
+            ranks.push_back({lo, hi}); w.push_back(m);
+        }
+    } else {
+        ranks.push_back({0, nb}); w.push_back(1.0);
+    }
+    if (k.access!=CpuKernel::UNIFORM) shuffle(blocks.begin(), blocks.end(), mt19937_64(0x452821E638D01377ull));
+
+    KernelShared sh;
+    double total = 0; for (double x : w) total += x;
+    double acc = 0;
+    for (size_t b=0;b<ranks.size();++b){
+        vector<uint8_t*> sub(blocks.begin() + ranks[b].first, blocks.begin() + ranks[b].second);
+        sh.chase_start.push_back(link_chase(sub, k.layout, threads));
+        acc += w[b];
+        sh.bucket_cdf.push_back(total > 0 ? acc / total : 1.0);
+    }
+    sh.bucket_cdf.back() = 1.0;
+    return sh;
+}
+
+static KernelShared prepare_kernel(const CpuKernel& k, int threads){
+    if (k.kind==CpuKernel::CHASE) return prepare_chase(k, threads);
+    return KernelShared();
+}
+
+// Per-worker kernel state. burst() keeps the core busy until the deadline and
+// counts one op per loop iteration (spin), cache-line access (cache) or
+// dependent load (chase).
+struct KernelWorker {
+    const CpuKernel& k;
+    uint64_t ops = 0;
+    double x = 1.0;
+    uint8_t* ws = nullptr;
+    size_t nlines = 0, mask = 0, cur = 0;
+    vector<uint8_t*> chase;        // current node per access bucket
+    const vector<double>* cdf = nullptr;
+    uint64_t rng = 0;
+    clk::time_point t_begin = clk::now();
+
+    // Scratch (cache working set) comes from the worker's arena, below its floor.
+    KernelWorker(const CpuKernel& kk, const KernelShared& sh, int id, Arena* arena) : k(kk) {
+        if (k.kind==CpuKernel::CHASE){
+            for (auto& b : sh.chase_start) chase.push_back(b[id]);
+            cdf = &sh.bucket_cdf;
+            rng = 0x9E3779B97F4A7C15ull * (uint64_t)(id + 1);
+        }
+        if (k.kind==CpuKernel::CACHE){
+            nlines = std::max<size_t>(1, k.ws_bytes / 64);
+            ws = arena ? (uint8_t*)arena->alloc(nlines*64) : nullptr;
+            if (!ws) throw runtime_error("arena reservation too small for ws (raise arena=)");
+            memset(ws, 0, nlines*64);
+            arena->mark_floor();
+            size_t m = 1; while (m < nlines) m <<= 1;
+            mask = m - 1;
+        }
+    }
+
+    void burst(clk::time_point until){
+        if (k.kind==CpuKernel::SPIN){
+            volatile double v = x;
+            while (clk::now() < until) {
+                // some flops
+                v = v * 1.000001 + 0.999999; ++ops;
+            }
+            x = v;
+            return;
+        }
+        if (k.kind==CpuKernel::CHASE){
+            uint64_t loads = 0;
+            auto t = clk::now();
+            const auto t_burst = t;
+            while (t < until){
+                if (k.rate > 0 && (double)ops >= k.rate * chrono::duration<double>(t - t_begin).count()) break;
+                size_t b = 0;
+                if (chase.size() > 1){
+                    rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;   // xorshift64
+                    double u = (double)(rng >> 11) * 0x1.0p-53;
+                    while (b + 1 < chase.size() && u >= (*cdf)[b]) ++b;
+                }
+                uint8_t* p = chase[b];
+                for (int i=0;i<64;++i) p = *(uint8_t**)p;
+                chase[b] = p;
+                loads += 64; ops += 64;
+                t = clk::now();
+            }
+            if (loads){
+                g_live.chase_loads.fetch_add(loads, memory_order_relaxed);
+                g_live.chase_ns.fetch_add((uint64_t)chrono::duration_cast<chrono::nanoseconds>(t - t_burst).count(), memory_order_relaxed);
+            }
+            return;
+        }
+        uint64_t acc = 0;
+        while (clk::now() < until){
+            if (k.pattern==CpuKernel::THRASH){
+                // Full-period LCG over the next power of two: every line is
+                // written once per cycle in an order the prefetcher can't follow.
+                for (int i=0;i<64;){
+                    cur = (cur * 6364136223846793005ull + 1442695040888963407ull) & mask;
+                    if (cur >= nlines) continue;
+                    ws[cur*64] += 1; ++i;
+                }
+            } else {
+                for (int i=0;i<64;++i){
+                    acc += ws[cur*64];
+                    if (++cur == nlines) cur = 0;
+                }
+            }
+            ops += 64;
+        }
+        x += (double)acc;
+    }
+};
+
+// ---------- allocator churn ----------
+// Temporary objects allocated/freed by CPU workers at a paced rate. Each
+// worker keeps up to `live` objects (FIFO) so lifetimes overlap and the
+// allocator has something to fragment; every page of an object is touched.
+struct SizeDist {
+    enum Kind { FIXED, UNIFORM, EXP } kind = FIXED;
+    size_t a = 4096, b = 0;   // FIXED: a; UNIFORM: [a,b]; EXP: mean a
+    size_t sample(mt19937_64& rng) const {
+        switch (kind){
+            case UNIFORM: return uniform_int_distribution<size_t>(a, b)(rng);
+            case EXP:     return std::max<size_t>(16, (size_t)exponential_distribution<double>(1.0/(double)a)(rng));
+            default:      return a;
+        }
+    }
+    double mean() const { return kind==UNIFORM ? 0.5 * ((double)a + (double)b) : (double)a; }
+};
+
+// "<SIZE>" | "<lo>-<hi>" | "exp:<mean>"
+static SizeDist parse_size_dist(const string& v){
+    SizeDist d;
+    if (v.rfind("exp:",0)==0){ d.kind = SizeDist::EXP; d.a = std::max<size_t>(16, parse_size_bytes(v.substr(4))); return d; }
+    auto dash = v.find('-', 1);
+    if (dash!=string::npos){
+        d.kind = SizeDist::UNIFORM;
+        d.a = parse_size_bytes(v.substr(0,dash)); d.b = parse_size_bytes(v.substr(dash+1));
+        if (d.a==0 || d.b<d.a) throw runtime_error("Invalid size range: "+v);
+        return d;
+    }
+    d.a = parse_size_bytes(v);
+    if (d.a==0) throw runtime_error("Invalid churn size: "+v);
+    return d;
+}
+
+struct ChurnSpec {
+    double rate = 0.0;        // allocations/s for the whole phase, 0 = off
+    SizeDist size;
+    enum Backend { MALLOC, ARENA, POOL } backend = MALLOC;
+    int live = 64;            // objects kept alive per worker (malloc/pool)
+    size_t arena_reserve = 0; // address space per worker arena, 0 = sized to the phase
+    TrimPolicy trim;
+};
+
+static const char* backend_name(ChurnSpec::Backend b){
+    switch (b){ case ChurnSpec::ARENA: return "arena"; case ChurnSpec::POOL: return "pool"; default: return "malloc"; }
+}
+
+// Process-wide pool: power-of-two size classes, one lock. Freed blocks go
+// back to the class list and are never returned to the OS.
+struct SharedPool {
+    mutex mtx;
+    vector<vector<void*>> free_lists = vector<vector<void*>>(48);
+    static int cls(size_t n){ int c=4; while (((size_t)1<<c) < n) ++c; return c; }
+    void* get(size_t n){
+        int c = cls(n);
+        { lock_guard<mutex> lk(mtx); auto& fl = free_lists[c]; if (!fl.empty()){ void* p = fl.back(); fl.pop_back(); return p; } }
+        return malloc((size_t)1<<c);
+    }
+    void put(void* p, size_t n){ lock_guard<mutex> lk(mtx); free_lists[cls(n)].push_back(p); }
+} g_pool;
+
+struct ChurnWorker {
+    const ChurnSpec& c;
+    double rate;                      // per worker
+    uint64_t max_per_step;            // two 10ms steps' worth; older debt is dropped
+    mt19937_64 rng;
+    clk::time_point t_begin = clk::now();
+    uint64_t allocs = 0, skipped = 0; // skipped: debt dropped after stalls
+    uint64_t failed = 0;              // arena exhausted / malloc returned null
+    struct Obj { void* p; size_t n; };
+    deque<Obj> ring;
+    Arena* arena = nullptr;           // set for alloc=arena
+    size_t live_bytes = 0, peak_live = 0;
+
+    ChurnWorker(const ChurnSpec& cs, int threads, int id)
+        : c(cs), rate(cs.rate / std::max(1, threads)),
+          max_per_step((uint64_t)(rate * 0.02) + 1), rng(0x5DEECE66Dull + (uint64_t)id) {}
+    ~ChurnWorker(){ while (!ring.empty()) release_oldest(); }
+
+    void release_oldest(){
+        Obj o = ring.front(); ring.pop_front();
+        if (c.backend==ChurnSpec::MALLOC) free(o.p);
+        else if (c.backend==ChurnSpec::POOL) g_pool.put(o.p, o.n);
+        live_bytes -= o.n;
+    }
+
+    void* obtain(size_t n){
+        if (c.backend==ChurnSpec::MALLOC) return malloc(n);
+        if (c.backend==ChurnSpec::POOL) return g_pool.get(n);
+        return arena ? arena->alloc(n) : nullptr;
+    }
+
+    // Catch up with the allocations owed at `now`; arena temporaries only
+    // live for one step and are dropped in O(1) at its start.
+    void step(clk::time_point now){
+        if (rate <= 0) return;
+        if (c.backend==ChurnSpec::ARENA && arena){ arena->reset(c.trim, now); live_bytes = 0; }
+        uint64_t owed = (uint64_t)(rate * chrono::duration<double>(now - t_begin).count()) - skipped;
+        uint64_t todo = owed > allocs ? owed - allocs : 0;
+        if (todo > max_per_step){ skipped += todo - max_per_step; todo = max_per_step; }
+        for (uint64_t i=0;i<todo;++i){
+            size_t n = c.size.sample(rng);
+            void* p = obtain(n);
+            if (!p){ ++failed; continue; }
+            uint8_t* b = (uint8_t*)p;
+            for (size_t off=0; off<n; off+=4096) b[off] = (uint8_t)off;
+            b[n-1] = 1;
+            live_bytes += n; ++allocs;
+            if (c.backend!=ChurnSpec::ARENA){
+                ring.push_back({p, n});
+                if ((int)ring.size() > c.live) release_oldest();
+            }
+            peak_live = std::max(peak_live, live_bytes);
+        }
+    }
+};
+
+// ---------- task engine ----------
+// sync=tasks: workers of a group execute trees of irregular tasks from
+// Chase-Lev work-stealing deques (one per worker). A region is one tree: the
+// root spawns `fanout` children down to `depth`, each task spawns its children
+// first (so thieves can take them) and then burns its own CPU cost, measured
+// in thread CPU time so a throttled worker does the same work, just later.
+// A new region starts when the previous one has fully drained.
+struct TaskSpec {
+    bool on = false;
+    SizeDist cost_ns;         // per-task CPU cost (ns)
+    int fanout = 4, depth = 4;
+    TaskSpec(){ cost_ns.a = 100000; }
+};
+
+// "<TIME>" | "<lo>-<hi>" | "exp:<mean>" in nanoseconds
+static SizeDist parse_time_dist(const string& v){
+    auto ns = [](const string& x){ return (size_t)std::max(1.0, parse_duration_seconds(x) * 1e9); };
+    SizeDist d;
+    if (v.rfind("exp:",0)==0){ d.kind = SizeDist::EXP; d.a = ns(v.substr(4)); return d; }
+    auto dash = v.find('-', 1);
+    if (dash!=string::npos){
+        d.kind = SizeDist::UNIFORM; d.a = ns(v.substr(0,dash)); d.b = ns(v.substr(dash+1));
+        if (d.b < d.a) throw runtime_error("Invalid task range: "+v);
+        return d;
+    }
+    d.a = ns(v);
+    return d;
+}
+
+// Fixed-capacity Chase-Lev deque (Le et al., PPoPP'13 C11 formulation).
+// Owner pushes/takes at the bottom, thieves steal from the top. Entries are
+// packed tasks; 0 means empty.
+struct WsDeque {
+    static const int64_t kCap = 1 << 14;
+    alignas(64) atomic<int64_t> top{0};
+    alignas(64) atomic<int64_t> bottom{0};
+    unique_ptr<atomic<uint64_t>[]> buf{new atomic<uint64_t>[kCap]};
+
+    bool push(uint64_t x){
+        int64_t b = bottom.load(memory_order_relaxed), t = top.load(memory_order_acquire);
+        if (b - t >= kCap) return false;
+        buf[b & (kCap - 1)].store(x, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        bottom.store(b + 1, memory_order_relaxed);
+        return true;
+    }
+    uint64_t take(){
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+        if (t > b){ bottom.store(b + 1, memory_order_relaxed); return 0; }
+        uint64_t x = buf[b & (kCap - 1)].load(memory_order_relaxed);
+        if (t == b){
+            if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) x = 0;
+            bottom.store(b + 1, memory_order_relaxed);
+        }
+        return x;
+    }
+    uint64_t steal(){
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+        if (t >= b) return 0;
+        uint64_t x = buf[t & (kCap - 1)].load(memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) return 0;
+        return x;
+    }
+};
+
+struct TaskPool {
+    vector<unique_ptr<WsDeque>> dq;
+    atomic<int64_t> pending{0};     // spawned but not finished, over the current region
+    atomic<uint64_t> regions{0};
+    explicit TaskPool(int threads){ for (int i=0;i<threads;++i) dq.emplace_back(new WsDeque()); }
+};
+
+// Spin briefly, then yield, then sleep: a thread waiting on a neighbour (pipeline
+// stage, idle task worker) must not burn the quota the neighbour needs.
+static void ring_backoff(int& spins){
+    ++spins;
+#if defined(__SSE2__)
+    if (spins < 64) { _mm_pause(); return; }
+#endif
+    if (spins < 128) this_thread::yield();
+    else this_thread::sleep_for(chrono::microseconds(50));
+}
+
+static uint64_t thread_cpu_ns(){
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Burn ns of this thread's CPU time (not wall time), so work that is
+// descheduled or throttled still completes, only later.
+static void burn_cpu_ns(uint64_t ns, double& x){
+    uint64_t until = thread_cpu_ns() + ns;
+    volatile double v = x;
+    do { for (int i=0;i<512;++i) v = v * 1.000001 + 0.999999; } while (thread_cpu_ns() < until);
+    x = v;
+}
+
+struct TaskWorker {
+    const TaskSpec& spec;
+    TaskPool& pool;
+    int id;
+    mt19937_64 rng;
+    uint64_t tasks = 0, steals = 0, steal_tries = 0;
+    double idle_s = 0, x = 1.0;
+
+    TaskWorker(const TaskSpec& sp, TaskPool& p, int i) : spec(sp), pool(p), id(i), rng(0x3C6EF372FE94F82Bull + (uint64_t)i) {}
+
+    // Task = depth+1 in the top 16 bits, so a valid task is never 0.
+    static uint64_t pack(int depth){ return (uint64_t)(depth + 1) << 48; }
+    static int depth_of(uint64_t t){ return (int)(t >> 48) - 1; }
+
+    void execute(uint64_t t){
+        int d = depth_of(t);
+        if (d < spec.depth)
+            for (int c=0;c<spec.fanout;++c){
+                pool.pending.fetch_add(1);
+                uint64_t child = pack(d + 1);
+                if (!pool.dq[id]->push(child)) execute(child);   // deque full: run inline
+            }
+        burn_cpu_ns(spec.cost_ns.sample(rng), x);
+        ++tasks;
+        pool.pending.fetch_sub(1);
+    }
+
+    uint64_t find_work(){
+        uint64_t t = pool.dq[id]->take();
+        if (t) return t;
+        int n = (int)pool.dq.size();
+        for (int k=0; k<2*n && n>1; ++k){
+            int v = (int)(rng() % (uint64_t)(n - 1)); if (v >= id) ++v;
+            ++steal_tries;
+            if ((t = pool.dq[v]->steal())){ ++steals; return t; }
+        }
+        int64_t zero = 0;
+        if (pool.pending.compare_exchange_strong(zero, 1)){ pool.regions.fetch_add(1); return pack(0); }
+        return 0;
+    }
+
+    // Run tasks until the deadline; a task started before it runs to completion.
+    void run_until(clk::time_point until){
+        int spins = 0;
+        auto idle_since = clk::now();
+        while (clk::now() < until){
+            uint64_t t = find_work();
+            if (!t){ ring_backoff(spins); continue; }
+            if (spins){ idle_s += chrono::duration<double>(clk::now() - idle_since).count(); spins = 0; }
+            execute(t);
+            idle_since = clk::now();
+        }
+        if (spins) idle_s += chrono::duration<double>(clk::now() - idle_since).count();
+    }
+};
+
+// ---------- BSP supersteps ----------
+// sync=bsp: every worker computes step*w_i (thread CPU time) and then waits at
+// a barrier. w_i is a per-thread lognormal weight with mean 1 and coefficient
+// of variation `imbalance`; with probability straggler_p a worker's share of
+// one step is multiplied by straggler_slow. Per step the planned critical path
+// is max_i(work_i): the job's own imbalance. Step wall time beyond it is what
+// the environment (quota, co-located pods, oversubscription) added.
+struct BspSpec {
+    bool on = false;
+    double step_s = 0.01;
+    double imbalance = 0;
+    double straggler_p = 0, straggler_slow = 1;
+};
+
+struct BspStats {
+    uint64_t steps = 0, straggles = 0;
+    double work_s = 0;        // sum over steps of sum_i work_i
+    double crit_s = 0;        // sum over steps of max_i work_i
+    double wall_s = 0;        // sum over steps of step wall time
+    vector<double> step_s, weights;
+};
+
+static BspStats run_bsp(double duration_s, int threads, const BspSpec& spec){
+    threads = std::max(1, threads);
+    BspStats st;
+    mt19937_64 wrng(0x9E3779B97F4A7C15ull);
+    double sig2 = log(1.0 + spec.imbalance * spec.imbalance);
+    lognormal_distribution<double> wd(-0.5 * sig2, sqrt(sig2));
+    for (int i=0;i<threads;++i) st.weights.push_back(spec.imbalance > 0 ? wd(wrng) : 1.0);
+
+    vector<double> planned(threads, 0.0);
+    vector<char> straggled(threads, 0);
+    atomic<int> arrived{0};
+    atomic<uint64_t> gen{0};
+    atomic<bool> done{false};
+    auto end = clk::now() + chrono::duration<double>(duration_s);
+    auto step_start = clk::now();
+
+    // The last thread to arrive closes the step and releases the others.
+    auto close_step = [&](){
+        auto now = clk::now();
+        double wall = chrono::duration<double>(now - step_start).count(), sum = 0, crit = 0;
+        for (int i=0;i<threads;++i){ sum += planned[i]; crit = std::max(crit, planned[i]); st.straggles += straggled[i]; }
+        st.steps++; st.work_s += sum; st.crit_s += crit; st.wall_s += wall; st.step_s.push_back(wall);
+        double eff = wall > 0 ? sum / (threads * wall) : 1.0;
+        g_live.bsp_steps.fetch_add(1, memory_order_relaxed);
+        g_live.bsp_eff_ppm.fetch_add((uint64_t)(std::min(1.0, eff) * 1e6), memory_order_relaxed);
+        if (g_trace.on){
+            ostringstream a; a << fixed << setprecision(3) << "\"step_ms\":" << wall * 1e3
+                               << ",\"crit_path_ms\":" << crit * 1e3 << ",\"efficiency\":" << eff;
+            trace_counter("bsp", now, a.str());
+        }
+        step_start = now;
+        done.store(now >= end || g_stop.load());
+        arrived.store(0, memory_order_relaxed);
+        gen.fetch_add(1, memory_order_release);
+    };
+
+    auto worker = [&](int id){
+        mt19937_64 rng(0xD1B54A32D192ED03ull + (uint64_t)id);
+        uniform_real_distribution<double> u01(0.0, 1.0);
+        ThreadPerf perf;
+        numa_bind_thread();
+        trace_thread(TRACK_CPU + id, "bsp worker " + to_string(id));
+        const auto t_start = clk::now();
+        double x = 1.0, work_s = 0;
+        uint64_t steps = 0, slow_steps = 0;
+        while (true){
+            bool slow = spec.straggler_p > 0 && u01(rng) < spec.straggler_p;
+            double work = spec.step_s * st.weights[id] * (slow ? spec.straggler_slow : 1.0);
+            auto a = clk::now();
+            burn_cpu_ns((uint64_t)(work * 1e9), x);
+            if (slow) trace_span(TRACK_CPU + id, "bsp", "straggler", a, clk::now());
+            planned[id] = work; straggled[id] = slow;
+            work_s += work; ++steps; slow_steps += slow;
+            uint64_t g = gen.load(memory_order_acquire);
+            if (arrived.fetch_add(1, memory_order_acq_rel) + 1 == threads) close_step();
+            else { int spins = 0; while (gen.load(memory_order_acquire) == g) ring_backoff(spins); }
+            if (done.load()) break;
         }
-    }
-    return 0;
+        trace_span(TRACK_CPU + id, "cpu", "bsp", t_start, clk::now(),
+                   "\"weight\":" + to_string(st.weights[id]) + ",\"steps\":" + to_string(steps)
+                   + ",\"stragglers\":" + to_string(slow_steps) + ",\"work_s\":" + to_string(work_s));
+    };
+    vector<thread> ts;
+    for (int i=0;i<threads;++i) ts.emplace_back(worker, i);
+    for (auto& t: ts) t.join();
+    return st;
 }
 
-// ---------- global memory pool ----------
-struct Buffer { unique_ptr<uint8_t[]> data; size_t size=0; };
-struct MemState {
-    vector<Buffer> bufs;
-    size_t total=0;
-    mutex mtx;
-} g_mem;
-
-static void commit_pages(uint8_t* p, size_t n){
-    // Touch one byte per page to commit RSS
-    if (!p || n==0) return;
-    const size_t stride = 4096;
-    volatile uint8_t sink=0;
-    for (size_t i=0; i<n; i+=stride) { p[i]++; sink ^= p[i]; }
-    (void)sink;
-}
+// util=<expr>: '+'-separated terms, clamped to [0,1], evaluated by every
+// worker once per duty-cycle period (t = seconds since the phase started):
+//   <x>               constant
+//   sin(min,max,T)    min + (max-min) * (1 + sin(2*pi*t/T)) / 2
+//   square(min,max,T) max for the first half of each period, min for the rest
+//   ramp(min,max,T)   sawtooth: min -> max linearly over each period
+//   noise(sigma)      zero-mean Gaussian, drawn per worker per period
+struct UtilWave {
+    struct Term { enum Kind { CONST, SIN, SQUARE, RAMP, NOISE } kind = CONST; double lo = 0, hi = 0, period = 0; };
+    vector<Term> terms;           // empty => plain constant util
+    string spec;
 
-static void alloc_add(size_t bytes, size_t chunk = (size_t)256<<20 /*256MiB*/) {
-    lock_guard<mutex> lk(g_mem.mtx);
-    size_t remain = bytes;
-    while (remain>0) {
-        size_t this_chunk = std::min(remain, chunk);
-        Buffer b;
-        b.data = unique_ptr<uint8_t[]>(new (nothrow) uint8_t[this_chunk]);
-        if (!b.data) throw bad_alloc();
-        b.size = this_chunk;
-        commit_pages(b.data.get(), b.size);
-        g_mem.total += b.size;
-        g_mem.bufs.push_back(std::move(b));
-        remain -= this_chunk;
+    // Deterministic part (noise contributes its zero mean).
+    double level(double t) const {
+        double u = 0;
+        for (auto& x : terms){
+            double ph = x.period > 0 ? t / x.period - floor(t / x.period) : 0.0;
+            switch (x.kind){
+                case Term::CONST:  u += x.lo; break;
+                case Term::SIN:    u += x.lo + (x.hi - x.lo) * 0.5 * (1.0 + sin(2.0 * M_PI * ph)); break;
+                case Term::SQUARE: u += ph < 0.5 ? x.hi : x.lo; break;
+                case Term::RAMP:   u += x.lo + (x.hi - x.lo) * ph; break;
+                case Term::NOISE:  break;
+            }
+        }
+        return u;
     }
-}
+    double mean() const {
+        double u = 0;
+        for (auto& x : terms) u += x.kind==Term::CONST ? x.lo : x.kind==Term::NOISE ? 0.0 : 0.5 * (x.lo + x.hi);
+        return u;
+    }
+    double sigma() const {
+        double v = 0;
+        for (auto& x : terms) if (x.kind==Term::NOISE) v += x.lo * x.lo;
+        return sqrt(v);
+    }
+};
 
-static void free_bytes(size_t bytes){
-    lock_guard<mutex> lk(g_mem.mtx);
-    size_t remain = bytes;
-    while (remain>0 && !g_mem.bufs.empty()){
-        Buffer& back = g_mem.bufs.back();
-        if (back.size <= remain) {
-            remain -= back.size;
-            g_mem.total -= back.size;
-            g_mem.bufs.pop_back();
+static UtilWave parse_util_wave(const string& spec){
+    UtilWave w; w.spec = spec;
+    int depth = 0; string cur;
+    vector<string> parts;
+    for (char c : spec){
+        if (c=='(') ++depth; else if (c==')') --depth;
+        if (c=='+' && depth==0){ parts.push_back(cur); cur.clear(); } else cur += c;
+    }
+    parts.push_back(cur);
+    for (auto& t : parts){
+        UtilWave::Term x;
+        size_t lp = t.find('(');
+        if (lp==string::npos){ x.lo = stod(t); w.terms.push_back(x); continue; }
+        if (t.back()!=')') throw runtime_error("Bad util term: "+t);
+        string fn = t.substr(0, lp);
+        vector<string> args;
+        stringstream ss(t.substr(lp + 1, t.size() - lp - 2)); string a;
+        while (getline(ss, a, ',')) args.push_back(a);
+        if (fn=="noise"){
+            if (args.size()!=1) throw runtime_error("noise expects (sigma): "+t);
+            x.kind = UtilWave::Term::NOISE; x.lo = stod(args[0]);
         } else {
-            size_t keep = back.size - remain;
-            unique_ptr<uint8_t[]> smaller(new (nothrow) uint8_t[keep]);
-            if (!smaller) throw bad_alloc();
-            memcpy(smaller.get(), back.data.get(), keep);
-            back.data.swap(smaller);
-            back.size = keep;
-            g_mem.total -= remain;
-            remain = 0;
+            if (fn=="sin") x.kind = UtilWave::Term::SIN;
+            else if (fn=="square") x.kind = UtilWave::Term::SQUARE;
+            else if (fn=="ramp") x.kind = UtilWave::Term::RAMP;
+            else throw runtime_error("Unknown util waveform: "+fn);
+            if (args.size()!=3) throw runtime_error(fn+" expects (min,max,period): "+t);
+            x.lo = stod(args[0]); x.hi = stod(args[1]); x.period = parse_duration_seconds(args[2]);
+            if (x.period <= 0) throw runtime_error("waveform period must be > 0: "+t);
         }
+        w.terms.push_back(x);
     }
+    return w;
 }
 
+struct CpuOptions {
+    CpuKernel kernel;
+    UtilWave wave;
+    TaskSpec tasks;
+    BspSpec bsp;
+    double period_s = 0.01;   // duty-cycle period; busy part = util * period
+    // free: each worker's periods run from its own start; aligned/stagger
+    // (set by period=, burst= or align=) use a fixed grid from the phase start,
+    // stagger shifting worker i by i/threads of a period.
+    enum Align { FREE, ALIGNED, STAGGER } align = FREE;
+    ChurnSpec churn;
+    double touch_rate = 0.0;  // bytes/s of the reservation faulted in by workers
+};
+
+struct CpuStats {
+    uint64_t ops = 0, allocs = 0, alloc_failed = 0; size_t peak_live = 0; double cpu_s = 0;
+    uint64_t tasks = 0, steals = 0, steal_tries = 0, regions = 0; double idle_s = 0;   // sync=tasks
+};
+
+// One role within a CPU phase (group=name:N@util[:kernel]); a plain CPU
+// phase is a single unnamed group.
+struct CpuGroup {
+    string name;
+    int threads = 1;
+    double util = 1.0;
+    CpuOptions opts;
+};
+
 // ---------- phases ----------
 struct Phase {
-    enum Type { MEM, CPU, SLEEP } type;
+    enum Type { MEM, CPU, SLEEP, MEMBW, PIPELINE, SHM } type;
     // common
-    double duration_s = 0.0; // only used for CPU/SLEEP (MEM applies instantly)
-    // mem
+    double duration_s = 0.0; // only used for CPU/SLEEP/MEMBW (MEM applies instantly)
+    // background memory behaviour for the length of the phase
+    double leak_rate = 0.0;   // bytes/s added to the pool, never freed
+    double gc_period_s = 0.0; // sawtooth: grow to gc_amp over a period, then collect
+    size_t gc_amp = 0;
+    // mem, shm
     int64_t mem_abs = -1;     // >=0 => set absolute size
     int64_t mem_delta = 0;    // !=0 => add/remove
-    // cpu
+    int64_t mem_reserve = -1; // >=0 => (re)map the reservation, 0 unmaps
+    size_t mem_touch = 0;     // bytes of the reservation to fault in
+    double touch_rate = 0.0;  // bytes/s, 0 => at once
+    bool has_numa = false;    // numa= given: switch placement before this phase
+    NumaSpec numa;
+    // shm
+    enum ShmBacking { SHM_CURRENT, SHM_MEMFD, SHM_DEVSHM } shm_backing = SHM_CURRENT;   // current: memfd if none yet
+    string shm_name;          // file / memfd name, default hpc_phase_sim[.<pid>]
+    bool shm_keep = false;    // leave the /dev/shm file behind at exit
     int cpu_threads = 1;
     double cpu_util = 1.0;    // 0..1
+    CpuOptions cpu_opts;
+    vector<CpuGroup> cpu_groups; // empty => one group of cpu_threads at cpu_util
+    // membw
+    enum BwMode { BW_READ, BW_WRITE, BW_COPY, BW_TRIAD } bw_mode = BW_COPY;
+    double bw_rate_gbs = 0.0; // 0 => unpaced
+    int bw_threads = 1;
+    bool bw_nt = false;       // non-temporal stores
+    // pipeline
+    int pipe_stages = 3;
+    size_t pipe_batch = (size_t)64<<10;
+    int pipe_depth = 64;           // batches per ring
+    vector<double> pipe_cost_s;    // CPU seconds per batch, per stage (last value repeats)
+    double pipe_rate = 0.0;        // source batches/s, 0 => as fast as backpressure allows
 };
 
-static void run_cpu(double duration_s, int threads, double util){
-    if (threads <= 0) threads = 1;
-    if (util < 0.0) util = 0.0; if (util > 1.0) util = 1.0;
+static const char* phase_type_name(Phase::Type t){
+    static const char* names[] = {"mem","cpu","sleep","membw","pipeline","shm"};
+    return names[t];
+}
+
+// Per-worker arena: the cache ws below the floor plus one step of arena churn
+// (exp sizes bounded at 8x the mean; rarer tails count as failed). Phases
+// using neither get no arena; arena= overrides the computed size.
+static size_t arena_need(const CpuOptions& o, uint64_t objs_per_step){
+    bool cache = o.kernel.kind==CpuKernel::CACHE;
+    bool churn = o.churn.rate > 0 && o.churn.backend==ChurnSpec::ARENA;
+    if (!cache && !churn) return 0;
+    if (o.churn.arena_reserve) return o.churn.arena_reserve;
+    size_t need = cache ? std::max<size_t>(1, o.kernel.ws_bytes / 64) * 64 : 0;
+    if (churn){
+        const SizeDist& d = o.churn.size;
+        size_t obj = d.kind==SizeDist::UNIFORM ? d.b : d.kind==SizeDist::EXP ? 8 * d.a : d.a;
+        need += objs_per_step * ((obj + 63) & ~(size_t)63);
+    }
+    const size_t huge = (size_t)2<<20;
+    return (need + huge - 1) & ~(huge - 1);
+}
 
+// Workers run on a fixed grid of period slots from the phase start, so
+// bursts land where designed; a slot whose busy window has already passed
+// (e.g. while throttled) is skipped rather than run late. Worker slots (arena,
+// trace track) are numbered across groups; kernel state is per group.
+static vector<CpuStats> run_cpu_groups(double duration_s, const vector<CpuGroup>& groups){
     atomic<bool> running{true};
-    vector<thread> ts; ts.reserve(threads);
+    mutex stats_mtx;
+    vector<CpuStats> stats(groups.size());
+    vector<thread> ts;
 
-    auto worker = [&running, util](){
-        const auto period = chrono::milliseconds(10);
-        const auto busy_ns = chrono::nanoseconds( (long long)(util * 1e7) );
-        volatile double x = 1.0;
+    vector<KernelShared> shared;
+    vector<unique_ptr<TaskPool>> pools;
+    for (auto& g : groups){
+        shared.push_back(prepare_kernel(g.opts.kernel, std::max(1, g.threads)));
+        pools.emplace_back(g.opts.tasks.on ? new TaskPool(std::max(1, g.threads)) : nullptr);
+    }
+    // churn= and touch= rates are per phase: every group carries the phase
+    // value, so split it over all the phase's threads, not each group's.
+    int phase_threads = 0;
+    for (auto& g : groups) phase_threads += std::max(1, g.threads);
+    const auto t_phase = clk::now();
+    string error;   // first worker failure, rethrown to run_phase after the join
+    auto body = [&](size_t gi, int id, int slot_id){
+        const CpuGroup& g = groups[gi];
+        const CpuOptions& opts = g.opts;
+        const int threads = std::max(1, g.threads);
+        const double util = std::min(1.0, std::max(0.0, g.util));
+        const auto period = chrono::duration_cast<clk::duration>(chrono::duration<double>(std::max(opts.period_s, 1e-4)));
+        auto busy = chrono::duration_cast<clk::duration>(period * util);
+        const bool waved = !opts.wave.terms.empty();
+        const double sigma = opts.wave.sigma();
+        mt19937_64 rng(0xD1B54A32D192ED03ull + (uint64_t)id);
+        normal_distribution<double> noise(0.0, sigma > 0 ? sigma : 1.0);
+        ThreadPerf perf;
+        numa_bind_thread();
+        trace_thread(TRACK_CPU + slot_id, (g.name.empty() ? string("cpu") : g.name) + " worker " + to_string(id));
+        const auto t_start = clk::now();
+        ChurnWorker cw(opts.churn, phase_threads, id);
+        size_t need = arena_need(opts, cw.max_per_step);
+        Arena* arena = need ? &worker_arena(slot_id, need) : nullptr;
+        if (opts.churn.backend==ChurnSpec::ARENA) cw.arena = arena;
+        KernelWorker kw(opts.kernel, shared[gi], id, arena);
+        unique_ptr<TaskWorker> tw(pools[gi] ? new TaskWorker(opts.tasks, *pools[gi], id) : nullptr);
+        size_t reported_live = 0;
+        double touched = 0.0;
+        prctl(PR_SET_TIMERSLACK, 1UL);   // default 50us slack eats sub-ms bursts
+        const bool grid = opts.align!=CpuOptions::FREE;
+        auto slot = t_phase + (opts.align==CpuOptions::STAGGER ? period * id / threads : clk::duration::zero());
         while (running.load(memory_order_relaxed) && !g_stop.load()){
             auto start = clk::now();
-            while (chrono::duration_cast<chrono::nanoseconds>(clk::now() - start) < busy_ns) {
-                // some flops
-                x = x * 1.000001 + 0.999999;
+            if (!grid) slot = start;
+            else if (start < slot){ this_thread::sleep_for(std::min<clk::duration>(chrono::milliseconds(50), slot - start)); continue; }
+            if (waved){
+                double u = opts.wave.level(chrono::duration<double>(slot - t_phase).count());
+                if (sigma > 0) u += noise(rng);
+                busy = chrono::duration_cast<clk::duration>(period * std::min(1.0, std::max(0.0, u)));
             }
-            auto elapsed = clk::now() - start;
-            auto sleep_left = period - chrono::duration_cast<chrono::nanoseconds>(elapsed);
-            if (sleep_left > chrono::nanoseconds(0)) this_thread::sleep_for(sleep_left);
+            cw.step(start);
+            if (opts.touch_rate > 0){
+                double owe = opts.touch_rate / phase_threads * chrono::duration<double>(start - t_start).count() - touched;
+                if (owe >= 4096) touched += std::max((double)resv_touch((size_t)owe), owe);  // stop owing once exhausted
+            }
+            if (cw.live_bytes != reported_live){
+                g_live.churn_live_bytes.fetch_add(cw.live_bytes - reported_live);
+                reported_live = cw.live_bytes;
+            }
+            if (tw) tw->run_until(slot + busy); else kw.burst(slot + busy);
+            if (!grid){
+                // Free-running: a late or descheduled thread still gets its full
+                // busy share, just shifted, so contended hosts keep the rate.
+                auto left = start + period - clk::now();
+                if (left > clk::duration::zero()) this_thread::sleep_for(left);
+                continue;
+            }
+            slot += period;
+            for (auto now = clk::now(); slot + busy < now; ) slot += period;
+        }
+        g_live.churn_live_bytes.fetch_sub(reported_live);
+        if (arena){
+            arena->reset(opts.churn.trim, clk::now());
+            arena->drop_floor(); arena->used = 0;
+            // The cache working set belongs to the phase, like any kernel
+            // buffer: give it back (with churn pages above it) whatever trim= says.
+            if (opts.churn.trim.kind==TrimPolicy::PHASE || opts.kernel.kind==CpuKernel::CACHE) arena->trim_to(0);
+        }
+        trace_span(TRACK_CPU + slot_id, "cpu", kernel_name(opts.kernel.kind), t_start, clk::now(),
+                   "\"util\":" + to_string(util) + ",\"ops\":" + to_string(kw.ops) + ",\"allocs\":" + to_string(cw.allocs));
+        timespec cpu{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        lock_guard<mutex> lk(stats_mtx);
+        CpuStats& st = stats[gi];
+        st.ops += kw.ops; st.allocs += cw.allocs; st.alloc_failed += cw.failed; st.peak_live += cw.peak_live;
+        st.cpu_s += (double)cpu.tv_sec + (double)cpu.tv_nsec * 1e-9;
+        if (tw){ st.tasks += tw->tasks; st.steals += tw->steals; st.steal_tries += tw->steal_tries; st.idle_s += tw->idle_s; }
+    };
+    auto worker = [&](size_t gi, int id, int slot_id){
+        try { body(gi, id, slot_id); }
+        catch (const exception& e){
+            lock_guard<mutex> lk(stats_mtx);
+            if (error.empty()) error = e.what();
+            running.store(false);
         }
-        (void)x;
     };
 
-    for (int i=0;i<threads;++i) ts.emplace_back(worker);
+    int slot_id = 0;
+    for (size_t gi=0; gi<groups.size(); ++gi)
+        for (int i=0; i<std::max(1, groups[gi].threads); ++i) ts.emplace_back(worker, gi, i, slot_id++);
     auto stop_at = clk::now() + chrono::duration<double>(duration_s);
+    while (running.load() && clk::now() < stop_at && !g_stop.load()) this_thread::sleep_for(chrono::milliseconds(50));
+    running.store(false);
+    for (auto& t: ts) t.join();
+    if (!error.empty()) throw runtime_error(error);
+    for (size_t gi=0; gi<groups.size(); ++gi) if (pools[gi]) stats[gi].regions = pools[gi]->regions.load();
+    return stats;
+}
+
+static CpuStats run_cpu(double duration_s, int threads, double util, const CpuOptions& opts = CpuOptions()){
+    CpuGroup g;
+    g.threads = threads; g.util = util; g.opts = opts;
+    return run_cpu_groups(duration_s, {g})[0];
+}
+
+// ---------- memory bandwidth ----------
+// Streaming kernels over [dst/src) byte ranges; n is a multiple of 64.
+// Return value only keeps the compiler from dropping reads.
+static uint64_t bw_read(const uint8_t* a, size_t n){
+#if defined(__SSE2__)
+    __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+    for (size_t i=0;i<n;i+=64){
+        const __m128i* p = (const __m128i*)(a+i);
+        acc0 = _mm_xor_si128(acc0, _mm_xor_si128(_mm_load_si128(p),   _mm_load_si128(p+1)));
+        acc1 = _mm_xor_si128(acc1, _mm_xor_si128(_mm_load_si128(p+2), _mm_load_si128(p+3)));
+    }
+    acc0 = _mm_xor_si128(acc0, acc1);
+    return (uint64_t)_mm_cvtsi128_si64(acc0) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc0, acc0));
+#else
+    uint64_t acc = 0; const uint64_t* p = (const uint64_t*)a;
+    for (size_t i=0;i<n/8;++i) acc ^= p[i];
+    return acc;
+#endif
+}
+
+static void bw_write(uint8_t* a, size_t n, uint64_t v, bool nt){
+#if defined(__SSE2__)
+    const __m128i x = _mm_set1_epi64x((long long)v);
+    __m128i* p = (__m128i*)a;
+    if (nt) { for (size_t i=0;i<n/16;i+=4){ _mm_stream_si128(p+i,x); _mm_stream_si128(p+i+1,x); _mm_stream_si128(p+i+2,x); _mm_stream_si128(p+i+3,x); } _mm_sfence(); }
+    else    { for (size_t i=0;i<n/16;i+=4){ _mm_store_si128(p+i,x);  _mm_store_si128(p+i+1,x);  _mm_store_si128(p+i+2,x);  _mm_store_si128(p+i+3,x); } }
+#else
+    (void)nt; uint64_t* p = (uint64_t*)a;
+    for (size_t i=0;i<n/8;++i) p[i] = v;
+#endif
+}
+
+static void bw_copy(uint8_t* dst, const uint8_t* src, size_t n, bool nt){
+#if defined(__SSE2__)
+    const __m128i* s = (const __m128i*)src; __m128i* d = (__m128i*)dst;
+    if (nt) {
+        for (size_t i=0;i<n/16;i+=4){
+            __m128i a=_mm_load_si128(s+i), b=_mm_load_si128(s+i+1), c=_mm_load_si128(s+i+2), e=_mm_load_si128(s+i+3);
+            _mm_stream_si128(d+i,a); _mm_stream_si128(d+i+1,b); _mm_stream_si128(d+i+2,c); _mm_stream_si128(d+i+3,e);
+        }
+        _mm_sfence();
+        return;
+    }
+#endif
+    (void)nt;
+    memcpy(dst, src, n);
+}
+
+// STREAM triad on doubles: a = b + s*c
+static void bw_triad(uint8_t* a, const uint8_t* b, const uint8_t* c, size_t n, bool nt){
+    const double s = 3.0;
+#if defined(__SSE2__)
+    const __m128d sv = _mm_set1_pd(s);
+    const double* pb = (const double*)b; const double* pc = (const double*)c; double* pa = (double*)a;
+    for (size_t i=0;i<n/8;i+=4){
+        __m128d r0 = _mm_add_pd(_mm_load_pd(pb+i),   _mm_mul_pd(sv, _mm_load_pd(pc+i)));
+        __m128d r1 = _mm_add_pd(_mm_load_pd(pb+i+2), _mm_mul_pd(sv, _mm_load_pd(pc+i+2)));
+        if (nt) { _mm_stream_pd(pa+i, r0); _mm_stream_pd(pa+i+2, r1); }
+        else    { _mm_store_pd(pa+i, r0);  _mm_store_pd(pa+i+2, r1); }
+    }
+    if (nt) _mm_sfence();
+#else
+    (void)nt;
+    const double* pb = (const double*)b; const double* pc = (const double*)c; double* pa = (double*)a;
+    for (size_t i=0;i<n/8;++i) pa[i] = pb[i] + s*pc[i];
+#endif
+}
+
+static atomic<uint64_t> g_bw_sink{0};
+
+// Each worker owns slice i of every committed buffer (64-byte aligned) and
+// streams over it in blocks, sleeping whenever it is ahead of rate/threads.
+static double run_membw(double duration_s, int threads, double rate_gbs, Phase::BwMode mode, bool nt){
+    if (threads <= 0) threads = 1;
+    struct Slice { uint8_t* p; size_t n; };
+    vector<vector<Slice>> slices(threads);
+    {
+        lock_guard<mutex> lk(g_mem.mtx);
+        for (auto& b : g_mem.bufs){
+            uint8_t* base = (uint8_t*)(((uintptr_t)b.data.get() + 63) & ~(uintptr_t)63);
+            size_t usable = b.size - (size_t)(base - b.data.get());
+            size_t per = (usable / threads) & ~(size_t)63;
+            for (int t=0;t<threads && per>=4096;++t) slices[t].push_back({base + t*per, per});
+        }
+    }
+    if (slices[0].empty()) throw runtime_error("membw phase needs committed memory (add a mem phase first)");
+
+    const int parts = (mode==Phase::BW_COPY) ? 2 : (mode==Phase::BW_TRIAD) ? 3 : 1;
+    const size_t block = (size_t)256<<10; // bytes per operand per step
+    const double per_thread_bps = rate_gbs * 1e9 / threads;
+    atomic<bool> running{true};
+    atomic<uint64_t> total_bytes{0};
+    vector<thread> ts; ts.reserve(threads);
+
+    auto worker = [&](int id){
+        ThreadPerf perf;
+        numa_bind_thread();
+        trace_thread(TRACK_BW + id, "membw worker " + to_string(id));
+        uint64_t moved = 0, sink = 0;
+        size_t si = 0, off = 0;
+        auto start = clk::now();
+        while (running.load(memory_order_relaxed) && !g_stop.load()){
+            const Slice& sl = slices[id][si];
+            size_t op = ((sl.n / parts) & ~(size_t)63);
+            size_t n = std::min(block, op - off);
+            uint8_t* a = sl.p + off; uint8_t* b = a + op; uint8_t* c = b + op;
+            switch (mode){
+                case Phase::BW_READ:  sink ^= bw_read(a, n); moved += n; break;
+                case Phase::BW_WRITE: bw_write(a, n, moved, nt); moved += n; break;
+                case Phase::BW_COPY:  bw_copy(b, a, n, nt); moved += 2*n; break;
+                case Phase::BW_TRIAD: bw_triad(a, b, c, n, nt); moved += 3*n; break;
+            }
+            off += n;
+            if (off >= op) { off = 0; si = (si + 1) % slices[id].size(); }
+            if (per_thread_bps > 0){
+                double ahead_s = (double)moved / per_thread_bps - chrono::duration<double>(clk::now() - start).count();
+                if (ahead_s > 0) this_thread::sleep_for(chrono::duration<double>(std::min(ahead_s, 0.05)));
+            }
+        }
+        total_bytes.fetch_add(moved);
+        g_bw_sink.fetch_xor(sink);
+        trace_span(TRACK_BW + id, "membw", "stream", start, clk::now(), "\"bytes\":" + to_string(moved));
+    };
+
+    auto t0 = clk::now();
+    for (int i=0;i<threads;++i) ts.emplace_back(worker, i);
+    auto stop_at = t0 + chrono::duration<double>(duration_s);
     while (clk::now() < stop_at && !g_stop.load()) this_thread::sleep_for(chrono::milliseconds(50));
     running.store(false);
     for (auto& t: ts) t.join();
+    double wall = chrono::duration<double>(clk::now() - t0).count();
+    return wall > 0 ? (double)total_bytes.load() / wall / 1e9 : 0.0;
+}
+
+// ---------- pipeline ----------
+// Streaming/ETL archetype: stage 0 allocates fixed-size batches, every stage
+// touches each cache line of the batch and then burns its per-batch CPU cost,
+// the last stage frees it. Stages hand batches on through bounded lock-free
+// SPSC rings; a full ring blocks the producer (backpressure), so a throttled
+// stage shows up as queues filling behind it and batches (memory) in flight.
+struct SpscRing {
+    vector<uint8_t*> slots;
+    size_t mask = 0, depth = 0;
+    alignas(64) atomic<size_t> head{0};   // next slot to pop (consumer only)
+    alignas(64) atomic<size_t> tail{0};   // next slot to push (producer only)
+
+    explicit SpscRing(size_t d) : depth(std::max<size_t>(1, d)) {
+        size_t cap = 1; while (cap < depth) cap <<= 1;
+        slots.resize(cap); mask = cap - 1;
+    }
+    bool push(uint8_t* b){
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) >= depth) return false;
+        slots[t & mask] = b;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+    uint8_t* pop(){
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) return nullptr;
+        uint8_t* b = slots[h & mask];
+        head.store(h + 1, memory_order_release);
+        return b;
+    }
+    size_t size() const { return tail.load(memory_order_acquire) - head.load(memory_order_acquire); }
+};
+
+struct StageStats {
+    uint64_t batches = 0;
+    double busy_s = 0, wait_in_s = 0, wait_out_s = 0, cpu_s = 0;
+    double occ_sum = 0; size_t occ_n = 0, occ_max = 0;   // output ring, sampled per push
+};
+
+static vector<StageStats> run_pipeline(const Phase& p, double& wall_s){
+    const int n = std::max(2, p.pipe_stages);
+    const size_t batch = std::max<size_t>(64, p.pipe_batch & ~(size_t)63);
+    vector<unique_ptr<SpscRing>> rings;
+    for (int i=0;i<n-1;++i) rings.emplace_back(new SpscRing((size_t)p.pipe_depth));
+    vector<StageStats> stats(n);
+    unique_ptr<atomic<bool>[]> done(new atomic<bool>[n]);
+    for (int i=0;i<n;++i) done[i].store(false);
+    atomic<bool> running{true};
+    const auto t0 = clk::now();
+    // Every stage stops at the deadline, not when the rings drain: batches
+    // still queued or finished late are dropped, so throughput is in-window.
+    const auto stop_at = t0 + chrono::duration_cast<clk::duration>(chrono::duration<double>(p.duration_s));
+    auto open = [&](){ return running.load(memory_order_relaxed) && clk::now() < stop_at; };
+
+    auto cost_of = [&](int i){
+        if (p.pipe_cost_s.empty()) return 0.0;
+        return p.pipe_cost_s[std::min((size_t)i, p.pipe_cost_s.size() - 1)];
+    };
+    auto stage = [&](int i){
+        ThreadPerf perf;
+        numa_bind_thread();
+        trace_thread(TRACK_PIPE + i, "pipeline stage " + to_string(i));
+        StageStats& st = stats[i];
+        // Thread CPU time, so a throttled stage falls behind and backs up the ring.
+        const uint64_t cost_ns = (uint64_t)(cost_of(i) * 1e9);
+        const auto t_begin = clk::now();
+        uint64_t sink = 0;
+        double x = 1.0;
+        while (!g_stop.load() && open()){
+            uint8_t* b = nullptr;
+            if (i==0){
+                auto now = clk::now();
+                if (p.pipe_rate > 0 && (double)st.batches >= p.pipe_rate * chrono::duration<double>(now - t0).count()){
+                    this_thread::sleep_for(chrono::microseconds(100));
+                    continue;
+                }
+                b = (uint8_t*)malloc(batch);
+                if (!b) throw bad_alloc();
+                g_live.pipe_inflight_bytes.fetch_add(batch);
+            } else {
+                int spins = 0; auto w0 = clk::now();
+                while (!(b = rings[i-1]->pop())){
+                    if (g_stop.load() || !open()) break;
+                    if (done[i-1].load()){ b = rings[i-1]->pop(); break; }   // drained
+                    ring_backoff(spins);
+                }
+                if (spins) st.wait_in_s += chrono::duration<double>(clk::now() - w0).count();
+                if (!b) break;
+            }
+            auto t = clk::now();
+            uint64_t* q = (uint64_t*)b;
+            for (size_t j=0; j<batch/8; j+=8){ sink += q[j]; q[j] = sink + (uint64_t)i; }
+            if (cost_ns) burn_cpu_ns(cost_ns, x);
+            auto t_done = clk::now();
+            st.busy_s += chrono::duration<double>(t_done - t).count();
+            if (t_done >= stop_at){ free(b); g_live.pipe_inflight_bytes.fetch_sub(batch); break; }
+            ++st.batches;
+            if (i==n-1){
+                free(b);
+                g_live.pipe_inflight_bytes.fetch_sub(batch);
+                g_live.pipe_batches.fetch_add(1, memory_order_relaxed);
+                continue;
+            }
+            int spins = 0; auto w0 = clk::now();
+            bool pushed;
+            while (!(pushed = rings[i]->push(b))){
+                if (g_stop.load() || !open()) break;
+                ring_backoff(spins);
+            }
+            if (!pushed){ free(b); g_live.pipe_inflight_bytes.fetch_sub(batch); break; }
+            if (spins) st.wait_out_s += chrono::duration<double>(clk::now() - w0).count();
+            size_t occ = rings[i]->size();
+            st.occ_sum += (double)occ; ++st.occ_n; st.occ_max = std::max(st.occ_max, occ);
+        }
+        done[i].store(true);
+        g_bw_sink.fetch_xor(sink);
+        timespec cpu{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        st.cpu_s = (double)cpu.tv_sec + (double)cpu.tv_nsec * 1e-9;
+        trace_span(TRACK_PIPE + i, "pipeline", "stage", t_begin, clk::now(), "\"batches\":" + to_string(st.batches));
+    };
+
+    vector<thread> ts;
+    for (int i=0;i<n;++i) ts.emplace_back(stage, i);
+    for (auto now = clk::now(); now < stop_at && !g_stop.load(); now = clk::now())
+        this_thread::sleep_for(std::min<clk::duration>(chrono::milliseconds(50), stop_at - now));
+    running.store(false);
+    for (auto& t : ts) t.join();
+    wall_s = chrono::duration<double>(std::min(clk::now(), stop_at) - t0).count();
+    // Batches still queued at the deadline (or on interrupt).
+    for (auto& r : rings) while (uint8_t* b = r->pop()){ free(b); g_live.pipe_inflight_bytes.fetch_sub(batch); }
+    return stats;
+}
+
+// ---------- memory probe ----------
+// Background "node health" probe: every interval, a short dependent-load chase
+// over a private buffer larger than typical L2 plus a short non-temporal copy.
+// Results are summed into g_live and averaged per [metrics] sample.
+static void mem_probe_loop(const atomic<bool>& running, double interval_s, size_t bytes){
+    const size_t copy_bytes = std::min(bytes / 4, (size_t)16<<20) & ~(size_t)63;
+    const size_t chase_bytes = (bytes - 2*copy_bytes) & ~(size_t)63;
+    void* m = mmap(nullptr, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (m==MAP_FAILED){ cerr << "MEMPROBE: mmap failed, probe disabled\n"; return; }
+    uint8_t* base = (uint8_t*)m;
+    const uint64_t nlines = chase_bytes / 64;
+    FeistelPerm perm(nlines, 0xB7E151628AED2A6Bull);
+    uint8_t* first = base + perm(0)*64; uint8_t* prev = first;
+    for (uint64_t i=1;i<nlines;++i){ uint8_t* cur = base + perm(i)*64; *(uint8_t**)prev = cur; prev = cur; }
+    *(uint8_t**)prev = first;
+    uint8_t* src = base + chase_bytes; uint8_t* dst = src + copy_bytes;
+    memset(src, 1, 2*copy_bytes);
+
+    const int loads = 4096;
+    const auto step = chrono::duration_cast<clk::duration>(chrono::duration<double>(interval_s));
+    uint8_t* p = first;
+    auto next = clk::now();
+    while (running.load() && !g_stop.load()){
+        auto t = clk::now();
+        for (int i=0;i<loads;++i) p = *(uint8_t**)p;
+        auto t1 = clk::now();
+        bw_copy(dst, src, copy_bytes, true);
+        auto t2 = clk::now();
+        double lat_ns = chrono::duration<double, nano>(t1 - t).count() / loads;
+        double copy_s = chrono::duration<double>(t2 - t1).count();
+        g_live.probe_lat_ps.fetch_add((uint64_t)(lat_ns * 1000.0));
+        g_live.probe_copy_mbs.fetch_add(copy_s > 0 ? (uint64_t)(2.0 * copy_bytes / copy_s / 1e6) : 0);
+        g_live.probe_count.fetch_add(1);
+        next += step;
+        while (running.load() && !g_stop.load() && clk::now() < next)
+            this_thread::sleep_for(std::min<clk::duration>(chrono::milliseconds(50), next - clk::now()));
+    }
+    g_bw_sink.fetch_xor((uint64_t)(uintptr_t)p);
+    munmap(m, bytes);
 }
 
 static void run_sleep(double duration_s) {
@@ -183,25 +2416,375 @@ static void run_sleep(double duration_s) {
     }
 }
 
+// ---------- leak / gc generators ----------
+// Background pacer for one timed phase. leak= grows the pool through
+// alloc_add in granules of >= 64 KiB (about 20 per second at most); the
+// memory stays in the pool after the phase. gc= keeps a private heap (one
+// mapping of amp bytes) that is touched linearly up to amp over each period
+// and MADV_DONTNEED'd at the boundary, like a collector returning a young
+// generation to the OS. Neither path holds g_mem.mtx while faulting pages in,
+// so samplers never wait on them.
+struct PacerStats { size_t leaked = 0, gc_peak = 0; uint64_t collections = 0; string error; };
+
+static void mem_pacer_loop(const atomic<bool>& running, const Phase& p, PacerStats& st){
+    const auto t0 = clk::now();
+    const size_t granule = std::max<size_t>((size_t)64<<10, (size_t)(p.leak_rate * 0.05)) & ~(size_t)4095;
+    uint8_t* heap = nullptr;
+    size_t heap_bytes = 0;
+    if (p.gc_period_s > 0){
+        void* m = mmap(nullptr, p.gc_amp, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (m==MAP_FAILED){ st.error = "gc heap mmap failed"; return; }
+        heap = (uint8_t*)m;
+    }
+    auto collect = [&](){
+        if (!heap_bytes) return;
+        madvise(heap, heap_bytes, MADV_DONTNEED);
+        g_live.gc_heap_bytes.fetch_sub(heap_bytes);
+        heap_bytes = 0;
+    };
+    while (running.load() && !g_stop.load()) try {
+        double t = chrono::duration<double>(clk::now() - t0).count();
+        if (p.leak_rate > 0){
+            double owe = p.leak_rate * t - (double)st.leaked;
+            if (owe >= (double)granule){ alloc_add((size_t)owe); st.leaked += (size_t)owe; }
+        }
+        if (p.gc_period_s > 0){
+            uint64_t cycle = (uint64_t)(t / p.gc_period_s);
+            if (cycle > st.collections){
+                collect();
+                st.collections = cycle;
+                trace_instant(TRACK_MAIN, "mem", "gc", clk::now());
+            }
+            size_t want = (size_t)((t / p.gc_period_s - (double)cycle) * (double)p.gc_amp) & ~(size_t)4095;
+            if (want > heap_bytes){
+                commit_pages(heap + heap_bytes, want - heap_bytes);
+                g_live.gc_heap_bytes.fetch_add(want - heap_bytes);
+                heap_bytes = want;
+                st.gc_peak = std::max(st.gc_peak, heap_bytes);
+            }
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    } catch (const exception& e) {
+        st.error = e.what();   // out of memory: stop pacing, keep the phase running
+        break;
+    }
+    collect();
+    if (heap) munmap(heap, p.gc_amp);
+}
+
+// Runs the pacer for the lifetime of the guard (joined even if the phase throws).
+struct MemPacer {
+    atomic<bool> running{true};
+    PacerStats st;
+    thread t;
+    explicit MemPacer(const Phase& p){
+        if (p.leak_rate > 0 || p.gc_period_s > 0) t = thread(mem_pacer_loop, cref(running), cref(p), ref(st));
+    }
+    bool stop(){ running.store(false); if (!t.joinable()) return false; t.join(); return true; }
+    ~MemPacer(){ stop(); }
+};
+
+// ---------- fidelity scorecard ----------
+// Planned timeline: each phase holds its nominal cores (threads*util for CPU,
+// 0 otherwise) and the alloc size implied by the phase list, starting at the
+// moment the phase actually began. Realized: sampled process CPU and VmRSS.
+struct FidelitySample { double t=0, cores=0; uint64_t rss_bytes=0; };
+struct PhaseWindow {
+    size_t idx=0; Phase::Type type=Phase::SLEEP;
+    double start=0, end=0;
+    double planned_cores=0;     // threads*util during CPU phases
+    bool cpu_planned=true;      // false when the phase has no nominal core count
+    double planned_util=0;
+    uint64_t planned_alloc=0;   // alloc bytes once the phase has applied
+    double leak_rate=0;         // pacer growth on top of planned_alloc while the phase runs
+    double gc_period_s=0; size_t gc_amp=0;
+    const UtilWave* wave=nullptr; // util waveform (planned cores follow its level)
+    int threads=0;
+};
+
+static void fidelity_sampler(const atomic<bool>& running, clk::time_point t0,
+                             double interval_s, vector<FidelitySample>& out){
+    double last_cpu = process_cpu_s();
+    auto last_t = clk::now();
+    auto next = last_t + chrono::duration<double>(interval_s);
+    while (running.load() && !g_stop.load()){
+        this_thread::sleep_until(next);
+        auto now = clk::now();
+        double cpu = process_cpu_s();
+        double dt = chrono::duration<double>(now - last_t).count();
+        FidelitySample s;
+        s.t = chrono::duration<double>(now - t0).count();
+        s.cores = dt > 0 ? (cpu - last_cpu) / dt : 0.0;
+        s.rss_bytes = read_vm_rss_kib() * 1024;
+        out.push_back(s);
+        last_cpu = cpu; last_t = now;
+        next += chrono::duration<double>(interval_s);
+    }
+}
+
+// Time from a planned step until the realized series covers 90% of the step.
+static double step_lag(const vector<FidelitySample>& s, double t_step, double from, double to,
+                       double (*val)(const FidelitySample&)){
+    double goal = from + 0.9 * (to - from);
+    for (auto& x : s){
+        if (x.t < t_step) continue;
+        if ((to > from && val(x) >= goal) || (to < from && val(x) <= goal)) return x.t - t_step;
+    }
+    return NAN;
+}
+
+static void report_fidelity(ostream& os, const string& job_name, const vector<FidelitySample>& samples,
+                            const vector<PhaseWindow>& win, uint64_t rss0_bytes, double nominal_s){
+    if (samples.empty() || win.empty()){ os << "[fidelity] name=" << job_name << " samples=0\n"; return; }
+    const double GiB = 1024.0*1024.0*1024.0;
+    auto planned_at = [&](double t) -> const PhaseWindow* {
+        const PhaseWindow* w = nullptr;
+        for (auto& x : win) if (x.start <= t) w = &x;
+        return w;
+    };
+    // Leak ramps up over the phase (and stays, via the next phase's
+    // planned_alloc); the gc heap is a sawtooth that only exists during it.
+    auto planned_bytes = [](const PhaseWindow& w, double t){
+        double b = (double)w.planned_alloc + w.leak_rate * (std::min(t, w.end) - w.start);
+        if (w.gc_period_s > 0 && t < w.end) b += fmod(t - w.start, w.gc_period_s) / w.gc_period_s * (double)w.gc_amp;
+        return b;
+    };
+    double cpu_se=0, cpu_peak=0, mem_se=0, mem_peak=0; size_t n=0, n_cpu=0;
+    for (auto& x : samples){
+        const PhaseWindow* w = planned_at(x.t);
+        if (!w) continue;
+        double me = ((double)x.rss_bytes - (planned_bytes(*w, x.t) + (double)rss0_bytes)) / GiB;
+        mem_se += me*me; ++n;
+        mem_peak = std::max(mem_peak, fabs(me));
+        if (!w->cpu_planned) continue;
+        double planned = w->wave ? w->threads * std::min(1.0, std::max(0.0, w->wave->level(x.t - w->start))) : w->planned_cores;
+        double ce = x.cores - planned;
+        cpu_se += ce*ce; ++n_cpu;
+        cpu_peak = std::max(cpu_peak, fabs(ce));
+    }
+    // Lags at planned step changes (phase boundaries where the nominal level moves).
+    double cpu_lag_sum=0, cpu_lag_max=0, mem_lag_sum=0, mem_lag_max=0;
+    size_t cpu_steps=0, mem_steps=0, missed=0;
+    auto cores_of = [](const FidelitySample& x){ return x.cores; };
+    auto rss_of   = [](const FidelitySample& x){ return (double)x.rss_bytes; };
+    double prev_cores = 0, prev_alloc = 0;
+    for (auto& w : win){
+        if (w.cpu_planned && fabs(w.planned_cores - prev_cores) >= 0.5){
+            double lag = step_lag(samples, w.start, prev_cores, w.planned_cores, cores_of);
+            if (std::isnan(lag)) ++missed; else { cpu_lag_sum += lag; cpu_lag_max = std::max(cpu_lag_max, lag); ++cpu_steps; }
+        }
+        if (fabs((double)w.planned_alloc - prev_alloc) >= 64.0*1024*1024){
+            double lag = step_lag(samples, w.start, prev_alloc + rss0_bytes, (double)w.planned_alloc + rss0_bytes, rss_of);
+            if (std::isnan(lag)) ++missed; else { mem_lag_sum += lag; mem_lag_max = std::max(mem_lag_max, lag); ++mem_steps; }
+        }
+        if (w.cpu_planned) prev_cores = w.planned_cores;
+        prev_alloc = (double)w.planned_alloc;
+    }
+    os << fixed << setprecision(3)
+       << "[fidelity] name=" << job_name
+       << " samples=" << n
+       << " cpu_rmse_cores=" << (n_cpu ? sqrt(cpu_se/n_cpu) : 0.0)
+       << " cpu_peak_err_cores=" << cpu_peak
+       << " mem_rmse_gib=" << (n ? sqrt(mem_se/n) : 0.0)
+       << " mem_peak_err_gib=" << mem_peak
+       << " cpu_lag_s_mean=" << (cpu_steps ? cpu_lag_sum/cpu_steps : 0.0)
+       << " cpu_lag_s_max=" << cpu_lag_max
+       << " mem_lag_s_mean=" << (mem_steps ? mem_lag_sum/mem_steps : 0.0)
+       << " mem_lag_s_max=" << mem_lag_max
+       << " steps_missed=" << missed
+       << " schedule_drift_s=" << (win.back().end - nominal_s)
+       << "\n";
+    for (auto& w : win){
+        if (w.type != Phase::CPU || !w.cpu_planned) continue;   // bsp: no planned util to compare
+        // Skip the ramp: first sample is the one that straddles the phase start.
+        double sum=0; size_t k=0;
+        for (size_t i=1;i<samples.size();++i)
+            if (samples[i-1].t >= w.start && samples[i].t <= w.end){ sum += samples[i].cores; ++k; }
+        double threads = w.planned_util > 0 ? w.planned_cores / w.planned_util : 0;
+        double realized = k ? sum/k : 0.0;
+        os << "[fidelity] name=" << job_name
+           << " phase=" << w.idx
+           << " planned_cores=" << w.planned_cores
+           << " realized_cores=" << realized
+           << " util_err=" << (threads > 0 ? realized/threads - w.planned_util : 0.0)
+           << " samples=" << k
+           << "\n";
+    }
+}
+
 // ---------- CLI ----------
 static void print_help(){
     cerr <<
 R"(simple_hpc_phases — minimal CPU/MEM/SLEEP phase emulator
 
 Usage:
-  simple_hpc_phases [--log-interval=1s] [--name=JOB] --phase <spec> [--phase <spec>...]
+  simple_hpc_phases [--log-interval=1s] [--name=JOB] [--fidelity[=100ms]]
+                    [--calibrate[=force]] [--calib-cache=PATH] [--mem-probe[=200ms]] [--mem-probe-size=64M]
+                    [--perf] [--trace-out=trace.json] [--wss[=1s]] [--wss-mode=auto|referenced|sampled]
+                    [--lock-memory]
+                    --phase <spec> [--phase <spec>...]
   simple_hpc_phases --help
 
 Phase specs:
   --phase type=mem,abs=<SIZE>|delta=<+/-SIZE>
-  --phase type=cpu,threads=<N>,util=<0..1>,duration=<TIME>
+  --phase type=mem,reserve=<SIZE>[,touch=<SIZE>[,rate=<SIZE>/s]]
+        [,numa=local|interleave[:<nodes>]|bind:<nodes>|default]   (nodes: 0, 0-1, 0+2)
+  --phase type=cpu,threads=<N>,util=<0..1|WAVE>,duration=<TIME>[,kernel=spin|cache]
+        WAVE: term[+term...], term = <x>|sin(min,max,T)|square(min,max,T)|ramp(min,max,T)|noise(sigma)
+        cache: [,ws=<L1|L2|LLC|f*LEVEL|SIZE>][,pattern=thrash|resident]
+        chase: [,ws=<SIZE>][,layout=global|huge][,rate=<loads/s per thread>]
+               [,access=uniform|zipf:<s>][,hot=<fraction>@<share>]
+        [,churn=<allocs>/s,size=<SIZE|lo-hi|exp:mean>,alloc=malloc|arena|pool,live=<N>]
+        [,arena=<SIZE reserved per thread>][,trim=never|phase|idle:<TIME>]
+        [,touch=<SIZE>/s]
+        [,sync=none|tasks][,task=<TIME|lo-hi|exp:mean>][,fanout=<N>][,depth=<N>]
+        [,sync=bsp][,step=<TIME>][,imbalance=<cv>][,straggler=<p>:<slowdown>]
+        [,period=<TIME>|burst=<on>/<off>][,align=aligned|stagger]
+        [,group=<name>:<N>@<util|WAVE|spin>[:spin|cache|chase] ...]
+  --phase type=shm,abs=<SIZE>|delta=<+/-SIZE>[,backing=memfd|devshm][,name=<file>][,keep=on|off]
+        [,duration=<TIME>]
   --phase type=sleep,duration=<TIME>
+  --phase type=membw,rate=<GB/s>,threads=<N>,mode=read|write|copy|triad,nt=on|off,duration=<TIME>
+  --phase type=pipeline,stages=<N>,duration=<TIME>[,batch=<SIZE>][,depth=<N>]
+        [,cost=<TIME>[/<TIME>...]][,rate=<batches/s>]
+  Any phase: [,leak=<SIZE>/s][,gc=<TIME>,amp=<SIZE>]
 
 Notes:
   - Memory 'mem' phases apply immediately (allocation or free) and persist.
-  - Sizes accept K,M,G,T (binary). TIME accepts ms,s,m,h.
+  - reserve= maps address space up front without touching it (VmSize grows,
+    VmRSS does not); reserve=0 unmaps. touch= faults in the next part of the
+    reservation front to back, paced at rate= if given; on a cpu phase,
+    touch=<SIZE>/s has the workers do it while they run. Metrics lines gain
+    VmSize_kib, resv_bytes and resv_touched_bytes while a reservation exists.
+  - shm phases size one shared-memory segment (MAP_SHARED, charged to the
+    cgroup as shmem and to emptyDir medium=Memory, not anon). backing=memfd
+    (default) vanishes with the process; backing=devshm creates
+    /dev/shm/<name> (default hpc_phase_sim.<pid>; an existing file is an
+    error, never reused), unlinked at exit unless keep=on. The backing is fixed until abs=0 releases the segment. SHM:
+    reports RssShmem_kib and the cgroup's memory.stat shmem; metrics lines
+    gain shm_bytes and RssShmem_kib while it is non-empty.
+  - numa= on a mem phase sets placement for this and later allocations (pool,
+    reservation, leak) via mbind, and pins later cpu/membw/pipeline workers to
+    the nodes' CPUs with the same set_mempolicy. local resolves once to the
+    node main runs on; interleave defaults to all online nodes. Metrics lines
+    gain numa_N<n>_kib (from /proc/self/numa_maps, re-read at most every 5s)
+    while a policy is set on a multi-node machine. On a single-node machine,
+    or if the syscalls are refused, it is a no-op.
+  - Workers burn util*period at the start of each duty period (default 10ms).
+    By default each worker's periods start when that worker does, so a late
+    thread still gets its share. period=, burst= or align= switch to a fixed
+    grid from the phase start instead; slots missed while descheduled or
+    throttled are skipped. burst=on/off (bare numbers are ms) sets period to
+    on+off and util to on/(on+off). align=aligned starts every worker's busy
+    window together (hits CFS quota edges hardest); align=stagger offsets
+    worker i by i/threads of a period.
+  - group= (repeatable) replaces threads/util with named thread roles, e.g.
+    group=compute:24@0.9,group=io:2@0.1,group=comm:1@spin. Each group has its
+    own util (spin = always busy) and optional kernel; the other phase keys
+    apply to all groups. At most one group may use chase. At the end each
+    group reports GROUP: cpu_s, cores and attained = cores / (N*util), which
+    shows which role a tight quota starves.
+  - sync=tasks replaces the kernel with a task-parallel runtime: each worker
+    owns a Chase-Lev deque, runs trees of tasks (every task spawns fanout
+    children down to depth, default 4/4, then burns task= CPU time, default
+    100us) and steals from random victims when its own deque is empty. A new
+    tree (region) starts once the previous one drained. The tail of every
+    region starves all but a few workers, so the critical path, not the
+    average task, decides how a quota hurts. TASKS: reports executed tasks,
+    steals, idle_s and idle_frac (share of busy windows spent finding work).
+  - sync=bsp runs back-to-back supersteps: each worker burns step (default
+    10ms) times its weight in thread CPU time, then waits at a barrier.
+    imbalance=<cv> draws per-thread lognormal weights (mean 1, that CV);
+    straggler=<p>:<slowdown> makes each worker, each step, slow by that
+    factor with probability p. util, kernel and churn do not apply. BSP:
+    reports the planned critical path (slowest worker's work), efficiency
+    (work / threads*wall), intrinsic_eff (the same against the critical
+    path: the job's own imbalance) and interference = wall / critical path,
+    i.e. what quota or co-located pods added. Metrics lines gain bsp_steps
+    and bsp_eff; --trace-out gets a per-step bsp counter.
+  - util waveforms are evaluated by each worker every duty period from
+    the phase start: sin is centered on (min+max)/2, square is max for the
+    first half of each period, ramp is a sawtooth, noise adds per-worker
+    Gaussian jitter. E.g. util=sin(0.2,0.8,60s)+noise(0.05). The fidelity
+    scorecard follows the waveform; per-phase util_err uses its mean.
+  - kernel=spin (default) burns registers only. kernel=cache walks a private
+    per-thread working set line by line (sizes from sysfs). L1/L2/SIZE are
+    per thread; LLC-relative sizes (default 0.5*LLC) are the phase's total,
+    split over its cache threads since they share the LLC:
+    pattern=thrash writes lines in random order to maximize LLC evictions,
+    pattern=resident re-reads them sequentially so they stay cached.
+  - kernel=chase links the committed memory (or its first ws bytes) into one
+    random cycle of 64-byte nodes and follows it with dependent loads
+    (canneal-like). layout=huge keeps each 2 MiB block together and asks for
+    THP. Metrics lines gain chase_ns_per_load while it runs.
+    access=zipf:s skews loads over 2 MiB blocks ranked in a fixed random
+    order (P(rank r) ~ r^-s, power-of-two rank buckets); hot=f@p sends a share
+    p of loads to a fraction f of the blocks. The cold rest stays resident
+    but idle, so it can be reclaimed cheaply (see --wss).
+  - churn= allocates temporaries from the CPU workers (rate is per phase).
+    malloc/pool keep the last `live` objects per worker (default 64); pool is
+    one locked size-class free list that never returns memory; arena is a
+    per-thread bump allocator reset every duty-cycle step. Metrics lines gain
+    churn_live_bytes while objects are live.
+  - Worker arenas (churn alloc=arena, cache kernel scratch) are created only
+    by phases that use them and reserve arena= of address space per thread
+    (default: the cache ws plus one 10ms step of churn, rounded to 2M). They
+    persist across phases and are re-reserved only when a phase needs more.
+    trim=never keeps touched pages, trim=phase drops them at phase end,
+    trim=idle:S drops pages above the recent peak after S idle seconds.
+    The cache kernel's working set is always released at phase end.
+    Metrics lines gain arena_bytes while arenas hold pages.
+  - leak= and gc= run a background pacer for the length of the phase. leak
+    grows the pool steadily (kept after the phase, freed only by mem phases);
+    gc grows a private heap linearly to amp over each period and drops it at
+    the boundary (sawtooth), released at phase end. Metrics lines gain
+    gc_heap_bytes while that heap is non-empty.
+  - 'pipeline' runs one thread per stage. Stage 0 mallocs batches (default
+    64K), every stage writes each cache line of a batch and then burns its
+    cost in thread CPU time (one value, or one per stage with '/'; the last
+    repeats; TIME accepts us), the last stage frees it. Stages pass batches through bounded
+    lock-free SPSC rings of depth batches (default 64); a full ring blocks the
+    upstream stage. All stages stop at duration; batches still queued then
+    are dropped, not drained. Ends with throughput (batches the last stage
+    finished in the window / duration) and per-stage busy/wait time and
+    queue occupancy; metrics lines gain pipe_batches_per_s and
+    pipe_inflight_bytes.
+  - 'membw' streams over the committed memory at a paced total rate (rate=0 or
+    omitted: unpaced). copy counts 2 bytes moved per byte, triad 3 (STREAM).
+  - Sizes accept K,M,G,T (binary). TIME accepts us,ms,s,m,h.
+  - --calibrate measures per-host ops/s, memory bandwidth and fault rate
+    before phase 1 (or loads them from the host-fingerprinted cache file,
+    default $XDG_CACHE_HOME or ~/.cache/hpc_phase_sim-calib-<fp>.txt).
 Metrics:
   Prints: [metrics] name=... elapsed_s=... alloc_bytes=... VmRSS_kib=...
+  --mem-probe runs a background thread that, every interval, chases 4096
+  dependent loads over a private buffer and does a short non-temporal copy;
+  metrics lines gain probe_ns_per_load and probe_copy_gbs (mean per sample).
+  The probe buffer (default 64M) counts towards VmRSS.
+  --perf opens per-thread perf_event_open counters on the main and worker
+  threads: cycles, instructions, LLC and dTLB misses (+ IPC), or task-clock,
+  page-faults and context-switches when no PMU is available. Each phase ends
+  with a PERF: line and metrics lines gain perf_* deltas per sample.
+  --wss estimates the working set touched in each window (default 1s) and
+  metrics lines gain wss_kib next to VmRSS_kib. referenced (default when
+  /proc/self/clear_refs is writable) clears the accessed bits of the whole
+  process each window and sums smaps Referenced:; sampled protects 256 random
+  pool pages per window and scales the fraction that faulted by alloc_bytes.
+  --trace-out writes a Chrome Trace Event Format file (chrome://tracing,
+  ui.perfetto.dev): phase spans on the main track, commit/free spans and
+  resize instants for mem phases, one span per CPU/membw worker slot and
+  phase, counters alloc_bytes, VmRSS_bytes and cgroup cpu_throttling at the
+  log interval, and a limit_change instant when cgroup CPU/memory limits move.
+  --fidelity samples CPU/RSS (default every 100ms) and prints at exit a
+  [fidelity] scorecard of planned vs realized: RMSE, peak error, lag at step
+  changes and per-CPU-phase util error.
+  --lock-memory mlock()s every committed pool chunk so it cannot be swapped.
+  Unprivileged runs stop locking at RLIMIT_MEMLOCK (ulimit -l); chunks that
+  do not fit or that mlock refuses stay unlocked and are counted. Mem phases
+  print a LOCK: line with locked_bytes, VmLck_kib and failures. Without it,
+  each phase ends with a SWAP: line (major faults during the phase, VmSwap_kib
+  and the cgroup's memory.swap.current or v1 memsw - usage), and metrics lines
+  gain majflt and VmSwap_kib whenever they are non-zero.
 Examples:
   # Start at 2 GiB, compute 60s, spike +4 GiB, sleep, free 5 GiB
   --phase type=mem,abs=2G
@@ -222,13 +2805,590 @@ static vector<pair<string,string>> split_kv(const string& s){
         out.emplace_back(cur.substr(0,eq), cur.substr(eq+1));
         cur.clear();
     };
+    int depth = 0;   // commas inside util=sin(...) etc. belong to the value
     for (; i<=s.size(); ++i){
         char c = (i<s.size()? s[i] : ',');
-        if (c==',') flush(); else cur.push_back(c);
+        if (c=='(') ++depth; else if (c==')') --depth;
+        if (c==',' && depth<=0) flush(); else cur.push_back(c);
     }
     return out;
 }
 
+// "<SIZE>[/s]" -> bytes per second
+static double parse_rate_bytes(const string& v){
+    string r = v; if (r.size()>2 && r.compare(r.size()-2,2,"/s")==0) r.resize(r.size()-2);
+    return (double)parse_size_bytes(r);
+}
+
+static CpuKernel::Kind parse_kernel_kind(const string& v, const string& spec){
+    if (v=="spin") return CpuKernel::SPIN;
+    if (v=="cache") return CpuKernel::CACHE;
+    if (v=="chase") return CpuKernel::CHASE;
+    throw runtime_error("Unknown kernel in: "+spec);
+}
+
+// group=<name>:<N>@<util|WAVE|spin>[:<kernel>]; other keys of the phase
+// (ws, churn, period, ...) apply to every group.
+// The cache working set and at least one churn object must fit in a worker's
+// arena; checked here because a worker thread cannot reject a spec. Later
+// arena exhaustion (many objects per step) is counted as failed allocations.
+static void check_arena_fit(const CpuOptions& o, const string& spec){
+    size_t need = 0;
+    if (o.kernel.kind==CpuKernel::CACHE) need += std::max<size_t>(1, o.kernel.ws_bytes / 64) * 64;
+    if (o.churn.rate > 0 && o.churn.backend==ChurnSpec::ARENA)
+        need += o.churn.size.kind==SizeDist::UNIFORM ? o.churn.size.b : o.churn.size.a;
+    if (o.churn.arena_reserve && need > o.churn.arena_reserve)
+        throw runtime_error("arena=" + to_string(o.churn.arena_reserve) + " cannot hold the cache ws plus one churn object ("
+                            + to_string(need) + " bytes) in: "+spec);
+}
+
+static CpuGroup parse_group(const string& v, const CpuOptions& base, const string& spec){
+    size_t c = v.find(':'), at = v.find('@');
+    if (c==string::npos || at==string::npos || at < c) throw runtime_error("group expects <name>:<N>@<util>[:kernel] in: "+spec);
+    CpuGroup g;
+    g.name = v.substr(0, c);
+    g.threads = stoi(v.substr(c + 1, at - c - 1));
+    g.opts = base;
+    string u = v.substr(at + 1);
+    size_t kc = u.rfind(':'), rp = u.rfind(')');
+    if (kc!=string::npos && (rp==string::npos || kc > rp)){ g.opts.kernel.kind = parse_kernel_kind(u.substr(kc + 1), spec); u.resize(kc); }
+    else if (u=="spin") g.opts.kernel.kind = CpuKernel::SPIN;
+    if (u=="spin") { g.util = 1.0; g.opts.wave = UtilWave(); }
+    else if (u.find('(')==string::npos) { g.util = stod(u); g.opts.wave = UtilWave(); }
+    else { g.opts.wave = parse_util_wave(u); g.util = std::min(1.0, std::max(0.0, g.opts.wave.mean())); }
+    if (g.name.empty() || g.threads <= 0) throw runtime_error("group needs a name and >= 1 thread in: "+spec);
+    return g;
+}
+
+static Phase parse_phase(const string& spec){
+    Phase p{};
+    string type;
+    double burst_on = -1, burst_off = -1;
+    bool grid = false;   // period= given: duty periods on the phase's fixed grid
+    bool ws_llc = false; // ws= is relative to the shared LLC
+    vector<string> group_specs;
+    for (auto& kv : split_kv(spec)) {
+        string k=kv.first, v=kv.second;
+        for (auto& c:k) c=tolower(c);
+        if (k=="type") { type=v; for (auto& c:type) c=tolower(c); }
+    }
+    if (type=="mem") p.type=Phase::MEM;
+    else if (type=="cpu") p.type=Phase::CPU;
+    else if (type=="sleep") p.type=Phase::SLEEP;
+    else if (type=="membw") p.type=Phase::MEMBW;
+    else if (type=="pipeline") p.type=Phase::PIPELINE;
+    else if (type=="shm") p.type=Phase::SHM;
+    else throw runtime_error("Unknown phase type in: "+spec);
+
+    for (auto& kv : split_kv(spec)){
+        string k=kv.first, v=kv.second; for (auto& c:k) c=tolower(c);
+        if (k=="duration") p.duration_s = parse_duration_seconds(v);
+        if (k=="leak") p.leak_rate = parse_rate_bytes(v);
+        if (k=="gc")   p.gc_period_s = parse_duration_seconds(v);
+        if (k=="amp")  p.gc_amp = (size_t)parse_size_bytes(v);
+        if (p.type==Phase::MEM){
+            if (k=="abs")   p.mem_abs   = (int64_t)parse_size_bytes(v);
+            if (k=="delta") p.mem_delta = (int64_t)parse_size_bytes(v);
+            if (k=="reserve") p.mem_reserve = (int64_t)parse_size_bytes(v);
+            if (k=="touch") p.mem_touch = (size_t)parse_size_bytes(v);
+            if (k=="rate")  p.touch_rate = parse_rate_bytes(v);
+            if (k=="numa") {
+                size_t c = v.find(':');
+                string pol = v.substr(0, c);
+                p.has_numa = true;
+                if (pol=="default") p.numa.policy = NUMA_DEFAULT;
+                else if (pol=="local") p.numa.policy = NUMA_LOCAL;
+                else if (pol=="interleave") p.numa.policy = NUMA_INTERLEAVE;
+                else if (pol=="bind") p.numa.policy = NUMA_BIND;
+                else throw runtime_error("numa must be local|interleave[:<nodes>]|bind:<nodes>|default in: "+spec);
+                if (c!=string::npos){
+                    if (p.numa.policy!=NUMA_INTERLEAVE && p.numa.policy!=NUMA_BIND) throw runtime_error("numa=" + pol + " takes no node list in: "+spec);
+                    for (int n : parse_id_list(v.substr(c + 1))){
+                        if (n < 0 || n >= kMaxNodes) throw runtime_error("numa node out of range in: "+spec);
+                        p.numa.nodes |= 1ull << n;
+                    }
+                }
+                if (p.numa.policy==NUMA_BIND && p.numa.nodes==0) throw runtime_error("numa=bind needs :<nodes> in: "+spec);
+                uint64_t off = p.numa.nodes & ~numa_online_mask();
+                if (off) throw runtime_error("numa node(s) " + numa_mask_str(off) + " not online in: "+spec);
+            }
+        } else if (p.type==Phase::SHM){
+            if (k=="abs")   p.mem_abs   = (int64_t)parse_size_bytes(v);
+            if (k=="delta") p.mem_delta = (int64_t)parse_size_bytes(v);
+            if (k=="backing") {
+                if (v=="memfd") p.shm_backing = Phase::SHM_MEMFD;
+                else if (v=="devshm") p.shm_backing = Phase::SHM_DEVSHM;
+                else throw runtime_error("backing must be memfd|devshm in: "+spec);
+            }
+            if (k=="name") {
+                if (v.empty() || v.find('/')!=string::npos) throw runtime_error("shm name must be a plain file name in: "+spec);
+                p.shm_name = v;
+            }
+            if (k=="keep") {
+                if (v=="on"||v=="1") p.shm_keep = true;
+                else if (v=="off"||v=="0") p.shm_keep = false;
+                else throw runtime_error("keep must be on|off in: "+spec);
+            }
+        } else if (p.type==Phase::CPU){
+            if (k=="threads") p.cpu_threads = stoi(v);
+            if (k=="util") {
+                if (v.find('(')==string::npos){ p.cpu_util = stod(v); p.cpu_opts.wave = UtilWave(); }
+                else { p.cpu_opts.wave = parse_util_wave(v); p.cpu_util = std::min(1.0, std::max(0.0, p.cpu_opts.wave.mean())); }
+            }
+            if (k=="kernel")  p.cpu_opts.kernel.kind = parse_kernel_kind(v, spec);
+            if (k=="group")   group_specs.push_back(v);
+            if (k=="ws")      p.cpu_opts.kernel.ws_bytes = parse_ws(v, &ws_llc);
+            if (k=="pattern") {
+                if (v=="thrash") p.cpu_opts.kernel.pattern = CpuKernel::THRASH;
+                else if (v=="resident") p.cpu_opts.kernel.pattern = CpuKernel::RESIDENT;
+                else throw runtime_error("Unknown pattern in: "+spec);
+            }
+            if (k=="layout") {
+                if (v=="global") p.cpu_opts.kernel.layout = CpuKernel::GLOBAL;
+                else if (v=="huge") p.cpu_opts.kernel.layout = CpuKernel::HUGE;
+                else throw runtime_error("Unknown layout in: "+spec);
+            }
+            if (k=="rate")    p.cpu_opts.kernel.rate = stod(v);
+            if (k=="access") {
+                if (v=="uniform") p.cpu_opts.kernel.access = CpuKernel::UNIFORM;
+                else if (v.rfind("zipf:",0)==0){ p.cpu_opts.kernel.access = CpuKernel::ZIPF; p.cpu_opts.kernel.zipf_s = stod(v.substr(5)); }
+                else throw runtime_error("Unknown access in: "+spec);
+            }
+            if (k=="hot") {
+                size_t at = v.find('@');
+                if (at==string::npos) throw runtime_error("hot expects <fraction>@<share> in: "+spec);
+                CpuKernel& kk = p.cpu_opts.kernel;
+                kk.access = CpuKernel::HOT; kk.hot_fraction = stod(v.substr(0, at)); kk.hot_share = stod(v.substr(at + 1));
+                if (kk.hot_fraction <= 0 || kk.hot_fraction > 1 || kk.hot_share < 0 || kk.hot_share > 1)
+                    throw runtime_error("hot fraction must be in (0,1] and share in [0,1] in: "+spec);
+            }
+            if (k=="churn") {
+                string r = v; if (r.size()>2 && r.compare(r.size()-2,2,"/s")==0) r.resize(r.size()-2);
+                p.cpu_opts.churn.rate = stod(r);
+            }
+            if (k=="size")    p.cpu_opts.churn.size = parse_size_dist(v);
+            if (k=="live")    p.cpu_opts.churn.live = std::max(1, stoi(v));
+            if (k=="alloc") {
+                if (v=="malloc") p.cpu_opts.churn.backend = ChurnSpec::MALLOC;
+                else if (v=="arena") p.cpu_opts.churn.backend = ChurnSpec::ARENA;
+                else if (v=="pool") p.cpu_opts.churn.backend = ChurnSpec::POOL;
+                else throw runtime_error("Unknown alloc backend in: "+spec);
+            }
+            if (k=="arena")   p.cpu_opts.churn.arena_reserve = std::max((size_t)parse_size_bytes(v), (size_t)1<<20);
+            if (k=="trim")    p.cpu_opts.churn.trim = parse_trim(v);
+            if (k=="touch")   p.cpu_opts.touch_rate = parse_rate_bytes(v);
+            if (k=="period"){ p.cpu_opts.period_s = parse_duration_seconds(v); grid = true; }
+            if (k=="sync") {
+                p.cpu_opts.tasks.on = v=="tasks";
+                p.cpu_opts.bsp.on = v=="bsp";
+                if (v!="tasks" && v!="bsp" && v!="none") throw runtime_error("Unknown sync in: "+spec);
+            }
+            if (k=="step")      p.cpu_opts.bsp.step_s = parse_duration_seconds(v);
+            if (k=="imbalance") p.cpu_opts.bsp.imbalance = std::max(0.0, stod(v));
+            if (k=="straggler") {
+                size_t c = v.find(':');   // ',' already separates phase keys
+                if (c==string::npos) throw runtime_error("straggler expects <p>:<slowdown> in: "+spec);
+                p.cpu_opts.bsp.straggler_p = std::min(1.0, std::max(0.0, stod(v.substr(0, c))));
+                p.cpu_opts.bsp.straggler_slow = std::max(1.0, stod(v.substr(c + 1)));
+            }
+            if (k=="task")    p.cpu_opts.tasks.cost_ns = parse_time_dist(v);
+            if (k=="fanout")  p.cpu_opts.tasks.fanout = std::max(1, stoi(v));
+            if (k=="depth")   p.cpu_opts.tasks.depth = std::max(0, stoi(v));
+            if (k=="burst") {
+                size_t sl = v.find('/');
+                if (sl==string::npos) throw runtime_error("burst expects <on>/<off> in: "+spec);
+                auto ms = [&](const string& x){ return x.find_first_not_of("0123456789.")==string::npos ? stod(x)/1000.0 : parse_duration_seconds(x); };
+                burst_on = ms(v.substr(0, sl)); burst_off = ms(v.substr(sl + 1));
+                if (burst_on < 0 || burst_off < 0 || burst_on + burst_off <= 0) throw runtime_error("burst needs on+off > 0 in: "+spec);
+            }
+            if (k=="align") {
+                if (v=="aligned") p.cpu_opts.align = CpuOptions::ALIGNED;
+                else if (v=="stagger") p.cpu_opts.align = CpuOptions::STAGGER;
+                else throw runtime_error("Unknown align in: "+spec);
+            }
+        } else if (p.type==Phase::PIPELINE){
+            if (k=="stages")  p.pipe_stages = stoi(v);
+            if (k=="batch")   p.pipe_batch  = (size_t)parse_size_bytes(v);
+            if (k=="depth")   p.pipe_depth  = std::max(1, stoi(v));
+            if (k=="rate")    p.pipe_rate   = stod(v);
+            if (k=="cost") {
+                p.pipe_cost_s.clear();
+                stringstream ss(v); string c;
+                while (getline(ss, c, '/')) p.pipe_cost_s.push_back(parse_duration_seconds(c));
+            }
+        } else if (p.type==Phase::MEMBW){
+            if (k=="rate")    p.bw_rate_gbs = stod(v);
+            if (k=="threads") p.bw_threads  = stoi(v);
+            if (k=="nt") {
+                if (v=="on"||v=="1") p.bw_nt = true;
+                else if (v=="off"||v=="0") p.bw_nt = false;
+                else throw runtime_error("nt must be on|off in: "+spec);
+            }
+            if (k=="mode") {
+                if (v=="read") p.bw_mode = Phase::BW_READ;
+                else if (v=="write") p.bw_mode = Phase::BW_WRITE;
+                else if (v=="copy") p.bw_mode = Phase::BW_COPY;
+                else if (v=="triad") p.bw_mode = Phase::BW_TRIAD;
+                else throw runtime_error("Unknown membw mode in: "+spec);
+            }
+        }
+    }
+    if (p.type==Phase::PIPELINE && p.pipe_stages < 2) throw runtime_error("pipeline needs stages >= 2 in: "+spec);
+    if (burst_on >= 0){
+        if (!p.cpu_opts.wave.terms.empty()) throw runtime_error("burst= and a util waveform are exclusive in: "+spec);
+        p.cpu_opts.period_s = burst_on + burst_off;
+        p.cpu_util = burst_on / (burst_on + burst_off);
+        grid = true;
+    }
+    if (grid && p.cpu_opts.align==CpuOptions::FREE) p.cpu_opts.align = CpuOptions::ALIGNED;
+    if (p.type==Phase::CPU && p.cpu_opts.period_s < 1e-4) throw runtime_error("period must be >= 0.1ms in: "+spec);
+    if (p.type==Phase::CPU){
+        BspSpec& b = p.cpu_opts.bsp;
+        if (b.imbalance > 0 || b.straggler_p > 0){
+            if (p.cpu_opts.tasks.on) throw runtime_error("imbalance/straggler apply to sync=bsp, not sync=tasks, in: "+spec);
+            b.on = true;
+        }
+        if (b.on && !group_specs.empty()) throw runtime_error("sync=bsp does not combine with group= in: "+spec);
+        if (b.on && b.step_s < 1e-5) throw runtime_error("step must be >= 10us in: "+spec);
+    }
+    if ((p.gc_period_s > 0) != (p.gc_amp > 0))
+        throw runtime_error("gc needs both gc=<TIME> and amp=<SIZE> in: "+spec);
+    if (p.type==Phase::CPU && !group_specs.empty()){
+        int chase = 0, n = 0; double cores = 0;
+        for (auto& gs : group_specs){
+            p.cpu_groups.push_back(parse_group(gs, p.cpu_opts, spec));
+            const CpuGroup& g = p.cpu_groups.back();
+            chase += g.opts.kernel.kind==CpuKernel::CHASE;
+            n += g.threads; cores += g.threads * g.util;
+        }
+        // Chase links the pool into one cycle in place; two groups would overwrite each other's links.
+        if (chase > 1) throw runtime_error("at most one group may use kernel=chase in: "+spec);
+        p.cpu_threads = n; p.cpu_util = cores / n;
+        p.cpu_opts.wave = UtilWave();
+    }
+    if (p.type==Phase::CPU && p.cpu_opts.kernel.access!=CpuKernel::UNIFORM){
+        bool chase = p.cpu_groups.empty() && p.cpu_opts.kernel.kind==CpuKernel::CHASE;
+        for (auto& g : p.cpu_groups) chase = chase || g.opts.kernel.kind==CpuKernel::CHASE;
+        if (!chase) throw runtime_error("access/hot skew needs kernel=chase in: "+spec);
+    }
+    if (p.type==Phase::CPU){
+        // Every cache thread shares the LLC: an LLC-relative ws (and the
+        // 0.5*LLC default) is the phase's footprint, split evenly over them so
+        // pattern=resident can actually stay cached.
+        vector<CpuKernel*> ks;
+        int n = 0;
+        if (p.cpu_groups.empty()){ ks.push_back(&p.cpu_opts.kernel); n = std::max(1, p.cpu_threads); }
+        else for (auto& g : p.cpu_groups) if (g.opts.kernel.kind==CpuKernel::CACHE){ ks.push_back(&g.opts.kernel); n += g.threads; }
+        for (CpuKernel* k : ks){
+            if (k->kind!=CpuKernel::CACHE) continue;
+            bool shared = ws_llc;
+            if (k->ws_bytes==0){ k->ws_bytes = parse_ws("0.5*LLC"); shared = true; }
+            if (!shared) continue;
+            k->ws_total = k->ws_bytes;
+            k->ws_bytes = std::max<size_t>(64, k->ws_total / n);
+        }
+    }
+    if (p.type==Phase::CPU){
+        if (p.cpu_groups.empty()) check_arena_fit(p.cpu_opts, spec);
+        for (auto& g : p.cpu_groups) check_arena_fit(g.opts, spec);
+    }
+    return p;
+}
+
+// ---------- metrics ----------
+static void log_metrics(ostream& os, const string& job_name, double elapsed){
+    size_t alloc = g_mem.total.load();
+    uint64_t rss_kib = read_vm_rss_kib();
+    os << fixed << setprecision(1)
+       << "[metrics] name=" << job_name
+       << " elapsed_s=" << elapsed
+       << " alloc_bytes=" << alloc
+       << " VmRSS_kib=" << rss_kib;
+    if (g_wss_valid.load()) os << " wss_kib=" << g_wss_kib.load();
+    if (g_resv.base)
+        os << " VmSize_kib=" << read_status_kib("VmSize:")
+           << " resv_bytes=" << g_resv.size << " resv_touched_bytes=" << std::min(g_resv.touched.load(), g_resv.size);
+    // Optional fields, only while the corresponding engine is producing data.
+    static uint64_t last_loads = 0, last_ns = 0;
+    uint64_t loads = g_live.chase_loads.load(), ns = g_live.chase_ns.load();
+    if (loads > last_loads) os << " chase_ns_per_load=" << (double)(ns - last_ns) / (double)(loads - last_loads);
+    last_loads = loads; last_ns = ns;
+    static uint64_t last_probes = 0, last_lat = 0, last_mbs = 0;
+    uint64_t probes = g_live.probe_count.load(), lat = g_live.probe_lat_ps.load(), mbs = g_live.probe_copy_mbs.load();
+    if (probes > last_probes){
+        double k = (double)(probes - last_probes);
+        os << " probe_ns_per_load=" << (double)(lat - last_lat) / 1000.0 / k
+           << " probe_copy_gbs=" << setprecision(2) << (double)(mbs - last_mbs) / 1000.0 / k;
+    }
+    last_probes = probes; last_lat = lat; last_mbs = mbs;
+    if (uint64_t live = g_live.churn_live_bytes.load()) os << " churn_live_bytes=" << live;
+    if (uint64_t held = Arena::g_arena_committed.load()) os << " arena_bytes=" << held;
+    if (uint64_t heap = g_live.gc_heap_bytes.load()) os << " gc_heap_bytes=" << heap;
+    if (size_t shm = g_shm.total.load()) os << " shm_bytes=" << shm << " RssShmem_kib=" << read_status_kib("RssShmem:");
+    if (g_numa.per_node.load(memory_order_acquire)){
+        // numa_maps makes the kernel walk every mapping's page tables: with a
+        // large pool, re-read it at most every 5s and repeat the last values.
+        static vector<uint64_t> numa_kib;
+        static clk::time_point numa_read{};
+        auto now = clk::now();
+        if (numa_kib.empty() || now - numa_read >= chrono::seconds(5)){ numa_kib = numa_node_kib(); numa_read = now; }
+        for (size_t n=0;n<numa_kib.size();++n) os << " numa_N" << n << "_kib=" << numa_kib[n];
+    }
+    static uint64_t last_majflt = major_faults();
+    uint64_t majflt = major_faults();
+    if (majflt > last_majflt) os << " majflt=" << (majflt - last_majflt);
+    last_majflt = majflt;
+    if (uint64_t sw = read_status_kib("VmSwap:")) os << " VmSwap_kib=" << sw;
+    static uint64_t last_batches = 0; static double last_elapsed = 0;
+    uint64_t batches = g_live.pipe_batches.load();
+    if (batches > last_batches && elapsed > last_elapsed)
+        os << " pipe_batches_per_s=" << setprecision(1) << (double)(batches - last_batches) / (elapsed - last_elapsed);
+    if (uint64_t fl = g_live.pipe_inflight_bytes.load()) os << " pipe_inflight_bytes=" << fl;
+    last_batches = batches; last_elapsed = elapsed;
+    static uint64_t last_steps = 0, last_eff = 0;
+    uint64_t steps = g_live.bsp_steps.load(), eff = g_live.bsp_eff_ppm.load();
+    if (steps > last_steps)
+        os << " bsp_steps=" << (steps - last_steps)
+           << " bsp_eff=" << setprecision(3) << (double)(eff - last_eff) / 1e6 / (double)(steps - last_steps);
+    last_steps = steps; last_eff = eff;
+    if (g_perf_mode!=PERF_OFF){
+        static PerfCounts last_perf;
+        PerfCounts now = perf_totals();
+        print_perf_delta(os, last_perf, now, "perf_");
+        last_perf = now;
+    }
+    os << "\n";
+}
+
+static void run_phase_body(const Phase& p){
+    // Result lines switch cerr to fixed; start every phase from the default
+    // format so detail lines (duration=, util=) read the same in any order.
+    cerr.unsetf(ios::floatfield);
+    cerr << setprecision(6);
+    if (p.type==Phase::MEM){
+        // Apply absolute first (if given), then delta.
+        auto resize = [](int64_t delta){
+            size_t before; { lock_guard<mutex> lk(g_mem.mtx); before = g_mem.total; }
+            auto t = clk::now();
+            if (delta > 0) alloc_add((size_t)delta); else free_bytes((size_t)(-delta));
+            if (!g_trace.on) return;
+            auto t1 = clk::now();
+            size_t after; { lock_guard<mutex> lk(g_mem.mtx); after = g_mem.total; }
+            trace_span(TRACK_MAIN, "mem", delta > 0 ? "commit" : "free", t, t1,
+                       "\"bytes\":" + to_string(delta > 0 ? delta : -delta));
+            trace_instant(TRACK_MAIN, "mem", "resize", t1,
+                          "\"from\":" + to_string(before) + ",\"to\":" + to_string(after));
+        };
+        if (p.mem_abs >= 0){
+            size_t target = (size_t)p.mem_abs;
+            size_t cur; { lock_guard<mutex> lk(g_mem.mtx); cur = g_mem.total; }
+            if (target != cur) resize((int64_t)target - (int64_t)cur);
+            cerr << "MEM: abs=" << target << " bytes\n";
+        }
+        if (p.mem_delta != 0){
+            resize(p.mem_delta);
+            if (p.mem_delta > 0) cerr << "MEM: +=" << (size_t)p.mem_delta << " bytes\n";
+            else cerr << "MEM: -=" << (size_t)(-p.mem_delta) << " bytes\n";
+        }
+        if (p.mem_reserve >= 0){
+            resv_set((size_t)p.mem_reserve);
+            cerr << "MEM: reserve=" << g_resv.size << " bytes VmSize_kib=" << read_status_kib("VmSize:") << "\n";
+            trace_instant(TRACK_MAIN, "mem", "reserve", clk::now(), "\"bytes\":" + to_string(g_resv.size));
+        }
+        if (g_lock_memory)
+            cerr << "LOCK: locked_bytes=" << g_locked_bytes.load() << " VmLck_kib=" << read_status_kib("VmLck:")
+                 << " failures=" << g_lock_failures.load() << " RLIMIT_MEMLOCK=" << memlock_limit_str() << "\n";
+        // After the MEM: lines: the first line of a phase is its detail line.
+        if (p.has_numa || g_numa.spec.policy!=NUMA_DEFAULT){
+            cerr << "NUMA:";
+            print_numa_policy(cerr);
+            if (g_numa.spec.policy!=NUMA_DEFAULT) print_numa_kib(cerr, "");
+            cerr << "\n";
+        }
+        if (p.mem_touch > 0){
+            if (!g_resv.base) throw runtime_error("touch needs a reservation (reserve=<SIZE> first)");
+            auto t = clk::now();
+            size_t done = 0;
+            if (p.touch_rate <= 0) done = resv_touch(p.mem_touch);
+            while (p.touch_rate > 0 && done < p.mem_touch && !g_stop.load()){
+                double owe = p.touch_rate * chrono::duration<double>(clk::now() - t).count() - (double)done;
+                size_t got = owe >= 4096 ? resv_touch(std::min((size_t)owe, p.mem_touch - done)) : 0;
+                if (owe >= 4096 && got==0) break;  // reservation exhausted
+                done += got;
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+            trace_span(TRACK_MAIN, "mem", "touch", t, clk::now(), "\"bytes\":" + to_string(done));
+            cerr << "MEM: touched=" << done << " bytes resv_touched=" << g_resv.touched.load()
+                 << "/" << g_resv.size << " VmRSS_kib=" << read_vm_rss_kib() << "\n";
+        }
+        if (p.duration_s > 0) run_sleep(p.duration_s); // optional hold time
+    } else if (p.type==Phase::CPU){
+        const CpuKernel& k = p.cpu_opts.kernel;
+        const ChurnSpec& ch = p.cpu_opts.churn;
+        if (p.cpu_opts.touch_rate > 0 && !g_resv.base) throw runtime_error("touch needs a reservation (reserve=<SIZE> first)");
+        cerr << "CPU: threads="<<p.cpu_threads<<" util="<<p.cpu_util<<" duration="<<p.duration_s<<"s";
+        if (!p.cpu_opts.wave.terms.empty()) cerr << " wave=" << p.cpu_opts.wave.spec;
+        if (p.cpu_opts.align!=CpuOptions::FREE)
+            cerr << " period=" << p.cpu_opts.period_s * 1e3 << "ms busy=" << p.cpu_util * p.cpu_opts.period_s * 1e3
+                 << "ms align=" << (p.cpu_opts.align==CpuOptions::STAGGER ? "stagger" : "aligned");
+        if (k.kind==CpuKernel::CACHE){
+            cerr << " kernel=" << kernel_name(k.kind) << " ws=" << k.ws_bytes;
+            if (k.ws_total) cerr << " ws_total=" << k.ws_total;
+            cerr << " pattern=" << (k.pattern==CpuKernel::THRASH ? "thrash" : "resident");
+        }
+        if (k.kind==CpuKernel::CHASE)
+            cerr << " kernel=" << kernel_name(k.kind) << " ws=" << k.ws_bytes
+                 << " layout=" << (k.layout==CpuKernel::HUGE ? "huge" : "global") << " rate=" << k.rate;
+        if (k.access==CpuKernel::ZIPF) cerr << " access=zipf:" << k.zipf_s;
+        if (k.access==CpuKernel::HOT)  cerr << " hot=" << k.hot_fraction << "@" << k.hot_share;
+        if (ch.rate > 0)
+            cerr << " churn=" << ch.rate << "/s alloc=" << backend_name(ch.backend) << " live=" << ch.live;
+        if (p.cpu_opts.touch_rate > 0) cerr << " touch=" << (uint64_t)p.cpu_opts.touch_rate << "B/s";
+        if (p.cpu_opts.tasks.on)
+            cerr << " sync=tasks fanout=" << p.cpu_opts.tasks.fanout << " depth=" << p.cpu_opts.tasks.depth
+                 << " task_mean_us=" << p.cpu_opts.tasks.cost_ns.mean() / 1e3;
+        const BspSpec& bsp = p.cpu_opts.bsp;
+        if (bsp.on){
+            cerr << " sync=bsp step=" << bsp.step_s * 1e3 << "ms imbalance=" << bsp.imbalance;
+            if (bsp.straggler_p > 0) cerr << " straggler=" << bsp.straggler_p << ":" << bsp.straggler_slow;
+        }
+        cerr << "\n";
+        if (bsp.on){
+            BspStats b = run_bsp(p.duration_s, p.cpu_threads, bsp);
+            vector<double> sorted = b.step_s;
+            sort(sorted.begin(), sorted.end());
+            auto pct = [&](double q){ return sorted.empty() ? 0.0 : sorted[std::min(sorted.size()-1, (size_t)(q * sorted.size()))]; };
+            double n = std::max(1, p.cpu_threads);
+            // efficiency = useful work / (threads * wall); intrinsic_eff is the
+            // same with wall replaced by the planned critical path, so
+            // interference = wall / critical path isolates the environment.
+            cerr << "BSP: steps=" << b.steps << fixed << setprecision(3)
+                 << " weight_min=" << *min_element(b.weights.begin(), b.weights.end())
+                 << " weight_max=" << *max_element(b.weights.begin(), b.weights.end())
+                 << " stragglers=" << b.straggles
+                 << " step_ms_p50=" << pct(0.5) * 1e3 << " step_ms_p99=" << pct(0.99) * 1e3
+                 << " crit_path_ms=" << (b.steps ? b.crit_s / b.steps * 1e3 : 0.0)
+                 << " efficiency=" << (b.wall_s > 0 ? b.work_s / (n * b.wall_s) : 0.0)
+                 << " intrinsic_eff=" << (b.crit_s > 0 ? b.work_s / (n * b.crit_s) : 0.0)
+                 << " interference=" << (b.crit_s > 0 ? b.wall_s / b.crit_s : 0.0) << "\n";
+            return;
+        }
+        bool kernel_ops = p.cpu_groups.empty() && k.kind!=CpuKernel::SPIN;
+        for (auto& g : p.cpu_groups){
+            cerr << "GROUP: name=" << g.name << " threads=" << g.threads << " util=" << g.util
+                 << " kernel=" << kernel_name(g.opts.kernel.kind);
+            if (g.opts.kernel.kind==CpuKernel::CACHE) cerr << " ws=" << g.opts.kernel.ws_bytes;
+            if (g.opts.kernel.ws_total) cerr << " ws_total=" << g.opts.kernel.ws_total;
+            if (!g.opts.wave.terms.empty()) cerr << " wave=" << g.opts.wave.spec;
+            cerr << "\n";
+            kernel_ops = kernel_ops || g.opts.kernel.kind!=CpuKernel::SPIN;
+        }
+        auto t = clk::now();
+        CpuStats st;
+        if (p.cpu_groups.empty()) st = run_cpu(p.duration_s, p.cpu_threads, p.cpu_util, p.cpu_opts);
+        else {
+            vector<CpuStats> gs = run_cpu_groups(p.duration_s, p.cpu_groups);
+            double wall = chrono::duration<double>(clk::now() - t).count();
+            for (size_t i=0;i<gs.size();++i){
+                const CpuGroup& g = p.cpu_groups[i];
+                double target = g.threads * g.util, cores = wall > 0 ? gs[i].cpu_s / wall : 0.0;
+                cerr << "GROUP: name=" << g.name << " cpu_s=" << fixed << setprecision(3) << gs[i].cpu_s
+                     << " cores=" << cores << " target_cores=" << target
+                     << " attained=" << (target > 0 ? cores / target : 0.0) << "\n";
+                st.ops += gs[i].ops; st.allocs += gs[i].allocs; st.alloc_failed += gs[i].alloc_failed; st.peak_live += gs[i].peak_live; st.cpu_s += gs[i].cpu_s;
+                st.tasks += gs[i].tasks; st.steals += gs[i].steals; st.steal_tries += gs[i].steal_tries;
+                st.regions += gs[i].regions; st.idle_s += gs[i].idle_s;
+            }
+        }
+        double dt = chrono::duration<double>(clk::now() - t).count();
+        if (kernel_ops)
+            cerr << "CPU: ops=" << st.ops << " rate=" << fixed << setprecision(1)
+                 << (dt > 0 ? st.ops/dt/1e6 : 0.0) << "M/s\n";
+        if (p.cpu_opts.tasks.on){
+            // idle_frac: share of the workers' busy windows spent looking for work
+            double busy_s = p.cpu_threads * p.cpu_util * dt;
+            cerr << "TASKS: executed=" << st.tasks << " rate=" << fixed << setprecision(0)
+                 << (dt > 0 ? st.tasks/dt : 0.0) << "/s regions=" << st.regions
+                 << " steals=" << st.steals << " steal_attempts=" << st.steal_tries
+                 << " steal_success=" << setprecision(3) << (st.steal_tries ? (double)st.steals/st.steal_tries : 0.0)
+                 << " idle_s=" << st.idle_s << " idle_frac=" << (busy_s > 0 ? std::min(1.0, st.idle_s/busy_s) : 0.0) << "\n";
+        }
+        if (ch.rate > 0)
+            cerr << "CHURN: allocs=" << st.allocs << " rate=" << fixed << setprecision(0)
+                 << (dt > 0 ? st.allocs/dt : 0.0) << "/s live_peak_bytes=" << st.peak_live
+                 << " failed=" << st.alloc_failed << " VmRSS_kib=" << read_vm_rss_kib() << "\n";
+    } else if (p.type==Phase::MEMBW){
+        static const char* modes[] = {"read","write","copy","triad"};
+        cerr << "MEMBW: threads="<<p.bw_threads<<" rate="<<p.bw_rate_gbs<<"GB/s mode="<<modes[p.bw_mode]
+             <<" nt="<<(p.bw_nt?"on":"off")<<" duration="<<p.duration_s<<"s\n";
+        if (g_calib.valid() && p.bw_rate_gbs > g_calib.mem_bw_gbs * std::max(1, p.bw_threads))
+            cerr << "MEMBW: warning: rate exceeds calibrated " << g_calib.mem_bw_gbs << " GB/s per thread\n";
+        double got = run_membw(p.duration_s, p.bw_threads, p.bw_rate_gbs, p.bw_mode, p.bw_nt);
+        cerr << "MEMBW: achieved=" << got << "GB/s\n";
+    } else if (p.type==Phase::SHM){
+        auto t = clk::now();
+        if (g_shm.fd >= 0 && p.shm_backing!=Phase::SHM_CURRENT && (p.shm_backing==Phase::SHM_DEVSHM) == g_shm.path.empty())
+            throw runtime_error("shm: backing is fixed while the segment exists (abs=0 releases it)");
+        size_t before = g_shm.total;
+        size_t target = p.mem_abs >= 0 ? (size_t)p.mem_abs : before;
+        target = (size_t)std::max<int64_t>(0, (int64_t)target + p.mem_delta);
+        if (target > before){
+            if (g_shm.fd < 0) shm_open_segment(p.shm_backing==Phase::SHM_DEVSHM, p.shm_name, p.shm_keep);
+            shm_add(target - before);
+        } else if (target < before) shm_free(before - target);
+        trace_span(TRACK_MAIN, "mem", target >= before ? "shm_commit" : "shm_free", t, clk::now(),
+                   "\"from\":" + to_string(before) + ",\"to\":" + to_string(g_shm.total.load()));
+        cerr << "SHM:";
+        if (g_shm.fd >= 0) cerr << " backing=" << (g_shm.path.empty() ? "memfd" : "devshm path=" + g_shm.path);
+        cerr << " bytes=" << g_shm.total.load() << " RssShmem_kib=" << read_status_kib("RssShmem:");
+        int64_t cg = read_cgroup_memory_stat("shmem");
+        if (cg >= 0) cerr << " cgroup_shmem_bytes=" << cg;
+        cerr << "\n";
+        if (p.duration_s > 0) run_sleep(p.duration_s); // optional hold time
+    } else if (p.type==Phase::PIPELINE){
+        cerr << "PIPELINE: stages=" << p.pipe_stages << " batch=" << p.pipe_batch << " depth=" << p.pipe_depth
+             << " rate=" << p.pipe_rate << "/s duration=" << p.duration_s << "s cost=";
+        for (int i=0;i<p.pipe_stages;++i)
+            cerr << (i ? "/" : "") << (p.pipe_cost_s.empty() ? 0.0 : p.pipe_cost_s[std::min((size_t)i, p.pipe_cost_s.size()-1)]) * 1e6 << "us";
+        cerr << "\n";
+        double wall = 0;
+        vector<StageStats> st = run_pipeline(p, wall);
+        const StageStats& last = st.back();
+        cerr << "PIPELINE: batches=" << last.batches << fixed << setprecision(1)
+             << " throughput=" << (wall > 0 ? last.batches / wall : 0.0) << "/s"
+             << " mb_s=" << (wall > 0 ? last.batches * (double)p.pipe_batch / wall / 1e6 : 0.0) << "\n";
+        for (size_t i=0;i<st.size();++i){
+            const StageStats& x = st[i];
+            cerr << "STAGE: i=" << i << " batches=" << x.batches << setprecision(3)
+                 << " busy_s=" << x.busy_s << " cpu_s=" << x.cpu_s
+                 << " wait_in_s=" << x.wait_in_s << " wait_out_s=" << x.wait_out_s;
+            if (i + 1 < st.size())
+                cerr << " queue_mean=" << setprecision(1) << (x.occ_n ? x.occ_sum / x.occ_n : 0.0)
+                     << " queue_max=" << x.occ_max << "/" << p.pipe_depth;
+            cerr << "\n";
+        }
+    } else {
+        cerr << "SLEEP: duration="<<p.duration_s<<"s\n";
+        run_sleep(p.duration_s);
+    }
+}
+
+static void run_phase(const Phase& p){
+    if (p.has_numa) numa_set(p.numa);   // before the pacer, which may allocate too
+    MemPacer pacer(p);
+    run_phase_body(p);
+    // One line at the end: the first line after "== Phase N ==" stays the
+    // phase's own detail line (metrics_to_columnar keys on it).
+    if (pacer.stop()){
+        cerr << defaultfloat << "PACER: leak=" << (uint64_t)p.leak_rate << "B/s gc=" << p.gc_period_s << "s amp=" << p.gc_amp
+             << " leaked=" << pacer.st.leaked << " gc_collections=" << pacer.st.collections
+             << " gc_peak_bytes=" << pacer.st.gc_peak;
+        if (!pacer.st.error.empty()) cerr << " error=" << pacer.st.error;
+        cerr << "\n";
+    }
+}
+
+#ifndef HPC_PHASE_SIM_NO_MAIN
 int main(int argc, char** argv){
     signal(SIGINT, on_sigint);
     signal(SIGTERM, on_sigint);
@@ -236,41 +3396,59 @@ int main(int argc, char** argv){
     vector<Phase> phases;
     double log_interval_s = 1.0;
     string job_name = "job";
+    double fidelity_interval_s = 0.0; // 0 => scorecard off
+    bool calibrate = false;
+    string calib_mode, calib_cache;
+    double probe_interval_s = 0.0;    // 0 => memory probe off
+    bool perf = false;
+    string trace_path;
+    double wss_interval_s = 0.0;      // 0 => working-set estimator off
+    WssMode wss_want = WSS_OFF;
+    size_t probe_bytes = (size_t)64<<20;
 
     for (int i=1;i<argc;++i){
         string arg = argv[i];
         if (arg=="--help"||arg=="-h"){ print_help(); return 0; }
         else if (arg.rfind("--log-interval=",0)==0){
-            log_interval_s = parse_duration_seconds(arg.substr(16));
+            log_interval_s = parse_duration_seconds(arg.substr(15));
         } else if (arg.rfind("--name=",0)==0){
             job_name = arg.substr(7);
+        } else if (arg=="--calibrate"){
+            calibrate = true;
+        } else if (arg.rfind("--calibrate=",0)==0){
+            calibrate = true; calib_mode = arg.substr(12);
+            if (calib_mode!="force"){ cerr<<"Unknown --calibrate mode: "<<calib_mode<<"\n"; return 1; }
+        } else if (arg.rfind("--calib-cache=",0)==0){
+            calib_cache = arg.substr(14);
+        } else if (arg=="--perf"){
+            perf = true;
+        } else if (arg=="--lock-memory"){
+            g_lock_memory = true;
+        } else if (arg=="--wss"){
+            wss_interval_s = 1.0;
+        } else if (arg.rfind("--wss=",0)==0){
+            wss_interval_s = parse_duration_seconds(arg.substr(6));
+        } else if (arg.rfind("--wss-mode=",0)==0){
+            string m = arg.substr(11);
+            if (m=="referenced") wss_want = WSS_REFERENCED;
+            else if (m=="sampled") wss_want = WSS_SAMPLED;
+            else if (m!="auto"){ cerr<<"Unknown --wss-mode: "<<m<<"\n"; return 1; }
+        } else if (arg.rfind("--trace-out=",0)==0){
+            trace_path = arg.substr(12);
+        } else if (arg=="--mem-probe"){
+            probe_interval_s = 0.2;
+        } else if (arg.rfind("--mem-probe=",0)==0){
+            probe_interval_s = parse_duration_seconds(arg.substr(12));
+        } else if (arg.rfind("--mem-probe-size=",0)==0){
+            probe_bytes = std::max((size_t)parse_size_bytes(arg.substr(17)), (size_t)1<<20);
+        } else if (arg=="--fidelity"){
+            fidelity_interval_s = 0.1;
+        } else if (arg.rfind("--fidelity=",0)==0){
+            fidelity_interval_s = parse_duration_seconds(arg.substr(11));
         } else if (arg=="--phase"){
             if (i+1>=argc){ cerr<<"Missing spec after --phase\n"; return 1; }
-            string spec = argv[++i];
-            Phase p{};
-            string type;
-            for (auto& kv : split_kv(spec)) {
-                string k=kv.first, v=kv.second;
-                for (auto& c:k) c=tolower(c);
-                if (k=="type") { type=v; for (auto& c:type) c=tolower(c); }
-            }
-            if (type=="mem") p.type=Phase::MEM;
-            else if (type=="cpu") p.type=Phase::CPU;
-            else if (type=="sleep") p.type=Phase::SLEEP;
-            else { cerr<<"Unknown phase type in: "<<spec<<"\n"; return 1; }
-
-            for (auto& kv : split_kv(spec)){
-                string k=kv.first, v=kv.second; for (auto& c:k) c=tolower(c);
-                if (k=="duration") p.duration_s = parse_duration_seconds(v);
-                if (p.type==Phase::MEM){
-                    if (k=="abs")   p.mem_abs   = (int64_t)parse_size_bytes(v);
-                    if (k=="delta") p.mem_delta = (int64_t)parse_size_bytes(v);
-                } else if (p.type==Phase::CPU){
-                    if (k=="threads") p.cpu_threads = stoi(v);
-                    if (k=="util")    p.cpu_util    = stod(v);
-                }
-            }
-            phases.push_back(p);
+            try { phases.push_back(parse_phase(argv[++i])); }
+            catch (const exception& e) { cerr<<e.what()<<"\n"; return 1; }
         } else {
             cerr<<"Unknown arg: "<<arg<<"\n"; print_help(); return 1;
         }
@@ -278,23 +3456,31 @@ int main(int argc, char** argv){
 
     if (phases.empty()){ print_help(); return 1; }
 
+    if (calibrate){
+        try { ensure_calibration(calib_mode, calib_cache); }
+        catch (const exception& e) { cerr<<e.what()<<"\n"; return 1; }
+    }
+
+    if (perf){
+        perf_init();
+        if (g_perf_mode==PERF_OFF) cerr << "PERF: perf_event_open unavailable, counters disabled\n";
+        else cerr << "PERF: mode=" << (g_perf_mode==PERF_HW ? "hardware" : "software") << "\n";
+    }
+    ThreadPerf main_perf; // main thread runs mem phases and kernel setup
+
     auto t0 = clk::now();
+    if (!trace_path.empty()){
+        try { trace_open(trace_path, t0, job_name); }
+        catch (const exception& e) { cerr<<e.what()<<"\n"; return 1; }
+    }
     atomic<bool> logging{true};
     thread logger([&](){
         auto next = t0 + chrono::duration<double>(log_interval_s);
         while (logging.load() && !g_stop.load()){
             auto now = clk::now();
             if (now >= next) {
-                double elapsed = chrono::duration<double>(now - t0).count();
-                size_t alloc;
-                { lock_guard<mutex> lk(g_mem.mtx); alloc = g_mem.total; }
-                uint64_t rss_kib = read_vm_rss_kib();
-                cerr << fixed << setprecision(1)
-                     << "[metrics] name=" << job_name
-                     << " elapsed_s=" << elapsed
-                     << " alloc_bytes=" << alloc
-                     << " VmRSS_kib=" << rss_kib
-                     << "\n";
+                log_metrics(cerr, job_name, chrono::duration<double>(now - t0).count());
+                trace_sample(now);
                 next += chrono::duration<double>(log_interval_s);
             } else {
                 this_thread::sleep_for(chrono::milliseconds(50));
@@ -302,36 +3488,105 @@ int main(int argc, char** argv){
         }
     });
 
+    vector<FidelitySample> fsamples;
+    vector<PhaseWindow> windows;
+    uint64_t rss0_bytes = read_vm_rss_kib() * 1024;
+    thread fsampler;
+    if (fidelity_interval_s > 0)
+        fsampler = thread(fidelity_sampler, cref(logging), t0, fidelity_interval_s, ref(fsamples));
+    thread wss;
+    if (wss_interval_s > 0){
+        g_wss_mode = wss_init(wss_want);
+        if (g_wss_mode==WSS_OFF) cerr << "WSS: no usable estimator, disabled\n";
+        else {
+            cerr << "WSS: mode=" << wss_mode_name(g_wss_mode) << " window=" << wss_interval_s << "s\n";
+            wss = thread(wss_loop, cref(logging), wss_interval_s);
+        }
+    }
+    thread prober;
+    if (probe_interval_s > 0){
+        prober = thread(mem_probe_loop, cref(logging), probe_interval_s, probe_bytes);
+        rss0_bytes += probe_bytes; // the probe buffer is part of the planned baseline
+    }
+
     size_t idx=0;
+    int rc = 0;
+    double nominal_s = 0.0;
+    int64_t planned_alloc = 0, planned_shm = 0;
     for (auto& p : phases){
         if (g_stop.load()) break;
         cerr << "== Phase " << (++idx) << " ==\n";
+        PhaseWindow w;
+        w.idx = idx; w.type = p.type;
         if (p.type==Phase::MEM){
-            // Apply absolute first (if given), then delta.
-            if (p.mem_abs >= 0){
-                size_t target = (size_t)p.mem_abs;
-                size_t cur; { lock_guard<mutex> lk(g_mem.mtx); cur = g_mem.total; }
-                if (target > cur) alloc_add(target - cur);
-                else if (target < cur) free_bytes(cur - target);
-                cerr << "MEM: abs=" << target << " bytes\n";
-            }
-            if (p.mem_delta != 0){
-                if (p.mem_delta > 0) { alloc_add((size_t)p.mem_delta); cerr << "MEM: +=" << (size_t)p.mem_delta << " bytes\n"; }
-                else { free_bytes((size_t)(-p.mem_delta)); cerr << "MEM: -=" << (size_t)(-p.mem_delta) << " bytes\n"; }
-            }
-            if (p.duration_s > 0) run_sleep(p.duration_s); // optional hold time
+            if (p.mem_abs >= 0) planned_alloc = p.mem_abs;
+            planned_alloc = std::max<int64_t>(0, planned_alloc + p.mem_delta);
         } else if (p.type==Phase::CPU){
-            cerr << "CPU: threads="<<p.cpu_threads<<" util="<<p.cpu_util<<" duration="<<p.duration_s<<"s\n";
-            run_cpu(p.duration_s, p.cpu_threads, p.cpu_util);
-        } else {
-            cerr << "SLEEP: duration="<<p.duration_s<<"s\n";
-            run_sleep(p.duration_s);
+            w.planned_util = std::min(1.0, std::max(0.0, p.cpu_util));
+            w.planned_cores = std::max(1, p.cpu_threads) * w.planned_util;
+            w.threads = std::max(1, p.cpu_threads);
+            if (!p.cpu_opts.wave.terms.empty()) w.wave = &p.cpu_opts.wave;
+            if (p.cpu_opts.bsp.on) w.cpu_planned = false;   // CPU follows the critical path, not util
+        } else if (p.type==Phase::MEMBW){
+            w.cpu_planned = false;
+        } else if (p.type==Phase::PIPELINE){
+            w.cpu_planned = false;   // CPU follows the slowest stage, not a nominal level
+        } else if (p.type==Phase::SHM){
+            if (p.mem_abs >= 0) planned_shm = p.mem_abs;
+            planned_shm = std::max<int64_t>(0, planned_shm + p.mem_delta);
+        }
+        w.planned_alloc = (uint64_t)(planned_alloc + planned_shm);
+        w.leak_rate = p.leak_rate; w.gc_period_s = p.gc_period_s; w.gc_amp = p.gc_amp;   // shm pages are mapped, so they count in VmRSS
+        auto pt = clk::now();
+        w.start = chrono::duration<double>(pt - t0).count();
+        PerfCounts perf0 = g_perf_mode!=PERF_OFF ? perf_totals() : PerfCounts();
+        uint64_t majflt0 = major_faults();
+        int64_t cg_swap0 = read_cgroup_swap_bytes();
+        string pname = "phase " + to_string(idx) + " " + phase_type_name(p.type);
+        try { run_phase(p); }
+        catch (const exception& e) {
+            cerr << "Phase " << idx << " failed: " << e.what() << "\n"; rc = 1;
+            trace_span(TRACK_MAIN, "phase", pname, pt, clk::now());
+            trace_instant(TRACK_MAIN, "phase", "phase_failed", clk::now(), "\"error\":\"" + json_escape(e.what()) + "\"");
+            break;
+        }
+        trace_span(TRACK_MAIN, "phase", pname, pt, clk::now(), "\"planned_cores\":" + to_string(w.planned_cores)
+                   + ",\"planned_alloc\":" + to_string(w.planned_alloc));
+        if (g_perf_mode!=PERF_OFF){
+            cerr << "PERF: phase=" << idx;
+            print_perf_delta(cerr, perf0, perf_totals(), "");
+            cerr << "\n";
         }
+        if (!g_lock_memory){
+            // Did the phase's memory get pushed to swap and faulted back in?
+            int64_t cg_swap = read_cgroup_swap_bytes();
+            cerr << "SWAP: phase=" << idx << " majflt=" << (major_faults() - majflt0)
+                 << " VmSwap_kib=" << read_status_kib("VmSwap:");
+            if (cg_swap >= 0) cerr << " cgroup_swap_bytes=" << cg_swap << " cgroup_swap_delta=" << (cg_swap - cg_swap0);
+            cerr << "\n";
+        }
+        w.end = chrono::duration<double>(clk::now() - t0).count();
+        planned_alloc += (int64_t)(p.leak_rate * (w.end - w.start));   // leaked bytes stay in the pool
+        nominal_s += p.duration_s;
+        windows.push_back(w);
     }
 
     logging.store(false);
     logger.join();
+    if (prober.joinable()) prober.join();
+    if (wss.joinable()) wss.join();
+    if (fsampler.joinable()){
+        fsampler.join();
+        report_fidelity(cerr, job_name, fsamples, windows, rss0_bytes, nominal_s);
+    }
+    if (g_trace.on){
+        trace_sample(clk::now());
+        trace_close();
+        cerr << "TRACE: events=" << g_trace.events << " path=" << trace_path << "\n";
+    }
+    shm_close();
     { lock_guard<mutex> lk(g_mem.mtx);
-      cerr << "Done. Total allocated bytes=" << g_mem.total << "\n"; }
-    return 0;
+      cerr << "Done. Total allocated bytes=" << g_mem.total.load() << "\n"; }
+    return rc;
 }
+#endif
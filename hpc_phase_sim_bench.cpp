@@ -0,0 +1,215 @@
+// hpc_phase_sim_bench.cpp
+// Self-benchmark for the hpc_phase_sim engines: page commit bandwidth, shrink
+// latency, duty-cycle accuracy, logger sampling cost and phase transition cost.
+// Results go to stdout as one "[bench] op=... key=value ..." line per case so
+// runs on different worker nodes can be diffed or loaded like [metrics] lines.
+//
+// Build: g++ -O2 -Wall -Wextra -std=c++17 -pthread hpc_phase_sim_bench.cpp -o hpc_phase_sim_bench
+
+#define HPC_PHASE_SIM_NO_MAIN
+// main() is compiled out, so the helpers only it calls would be unused here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "hpc_phase_sim.cpp"
+#pragma GCC diagnostic pop
+
+#include <algorithm>
+#include <unistd.h>
+
+// ---------- helpers ----------
+static double now_s(){ return chrono::duration<double>(clk::now().time_since_epoch()).count(); }
+
+static double median(vector<double> v){
+    if (v.empty()) return 0.0;
+    sort(v.begin(), v.end());
+    return v[v.size()/2];
+}
+
+static void reset_pool(){
+    lock_guard<mutex> lk(g_mem.mtx);
+    g_mem.bufs.clear();
+    g_mem.total = 0;
+}
+
+struct BenchOpts {
+    int reps = 5;
+    size_t max_size = (size_t)1<<30;   // largest commit/shrink size
+    double cpu_duration_s = 1.0;       // per run_cpu accuracy case
+    string only;                       // comma list of ops, empty = all
+};
+
+static bool want(const BenchOpts& o, const string& op){
+    if (o.only.empty()) return true;
+    size_t pos = 0;
+    while (pos <= o.only.size()){
+        size_t c = o.only.find(',', pos);
+        if (o.only.substr(pos, c==string::npos ? string::npos : c-pos) == op) return true;
+        if (c==string::npos) break;
+        pos = c+1;
+    }
+    return false;
+}
+
+// ---------- cases ----------
+static void bench_commit_pages(const BenchOpts& o){
+    for (size_t sz = (size_t)64<<20; sz <= o.max_size; sz *= 4){
+        vector<double> gibs;
+        for (int r=0; r<o.reps; ++r){
+            unique_ptr<uint8_t[]> buf(new (nothrow) uint8_t[sz]);
+            if (!buf) throw bad_alloc();
+            double t = now_s();
+            commit_pages(buf.get(), sz);
+            double dt = now_s() - t;
+            gibs.push_back((double)sz / (1024.0*1024.0*1024.0) / dt);
+        }
+        cout << fixed << setprecision(3)
+             << "[bench] op=commit_pages size_bytes=" << sz
+             << " reps=" << o.reps
+             << " gib_s_median=" << median(gibs)
+             << " gib_s_max=" << *max_element(gibs.begin(), gibs.end()) << "\n";
+    }
+}
+
+static void bench_free_bytes(const BenchOpts& o){
+    // Shrinks inside one 256 MiB chunk take the copy path; a full chunk is a pop.
+    const size_t chunk = std::min(o.max_size, (size_t)256<<20);
+    const size_t sizes[] = { 4096, (size_t)1<<20, (size_t)16<<20, chunk/2, chunk };
+    for (size_t sz : sizes){
+        if (sz > chunk) continue;
+        vector<double> us;
+        for (int r=0; r<o.reps; ++r){
+            reset_pool();
+            alloc_add(chunk);
+            double t = now_s();
+            free_bytes(sz);
+            us.push_back((now_s() - t) * 1e6);
+        }
+        reset_pool();
+        cout << fixed << setprecision(1)
+             << "[bench] op=free_bytes chunk_bytes=" << chunk
+             << " shrink_bytes=" << sz
+             << " reps=" << o.reps
+             << " us_median=" << median(us)
+             << " us_max=" << *max_element(us.begin(), us.end()) << "\n";
+    }
+}
+
+static void bench_run_cpu(const BenchOpts& o){
+    int ncpu = (int)std::max(1u, thread::hardware_concurrency());
+    vector<int> thread_counts = {1, std::max(1, ncpu/2), ncpu};
+    thread_counts.erase(unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+    const double utils[] = {0.25, 0.5, 0.9};
+    const double periods_ms[] = {1, 10, 100};
+    for (int th : thread_counts){
+        for (double pm : periods_ms){
+            for (double u : utils){
+                CpuOptions opts;
+                opts.period_s = pm / 1000.0;
+                if (pm != 10) opts.align = CpuOptions::ALIGNED;   // as period= on the command line
+                double c0 = process_cpu_s(), t0 = now_s();
+                run_cpu(o.cpu_duration_s, th, u, opts);
+                double wall = now_s() - t0, cpu = process_cpu_s() - c0;
+                double cores = cpu / wall, target = th * u;
+                cout << fixed << setprecision(3)
+                     << "[bench] op=run_cpu threads=" << th
+                     << " util=" << u
+                     << " period_ms=" << setprecision(0) << pm << setprecision(3)
+                     << " align=" << (opts.align==CpuOptions::FREE ? "free" : "aligned")
+                     << " target_cores=" << target
+                     << " measured_cores=" << cores
+                     << " rel_error=" << (cores - target) / target << "\n";
+            }
+        }
+    }
+}
+
+static void bench_logger(const BenchOpts& o){
+    ostringstream sink;
+    const int n = 2000;
+    vector<double> us;
+    for (int r=0; r<o.reps; ++r){
+        sink.str(string());
+        double t = now_s();
+        for (int i=0;i<n;++i) log_metrics(sink, "bench", (double)i);
+        us.push_back((now_s() - t) * 1e6 / n);
+    }
+    cout << fixed << setprecision(2)
+         << "[bench] op=logger_sample samples=" << n
+         << " reps=" << o.reps
+         << " us_per_sample_median=" << median(us) << "\n";
+}
+
+static void bench_phase_transition(const BenchOpts& o){
+    // Zero-length sleep/cpu phases: what remains is dispatch plus thread
+    // spawn/join. mem grows then shrinks the pool by 64 MiB each rep, so the
+    // alloc_add and free_bytes paths are part of the transition.
+    int ncpu = (int)std::max(1u, thread::hardware_concurrency());
+    const vector<vector<pair<const char*, string>>> cases = {
+        {{"sleep", "type=sleep,duration=0s"}},
+        {{"cpu",   "type=cpu,threads=" + to_string(ncpu) + ",util=0.5,duration=0s"}},
+        {{"mem_grow", "type=mem,delta=+64M"}, {"mem_shrink", "type=mem,delta=-64M"}},
+    };
+    for (auto& steps : cases){
+        vector<Phase> ps;
+        for (auto& st : steps) ps.push_back(parse_phase(st.second));
+        vector<vector<double>> us(steps.size());
+        reset_pool();
+        for (int r=0; r<o.reps*4; ++r){
+            for (size_t i=0; i<ps.size(); ++i){
+                double t = now_s();
+                run_phase(ps[i]);
+                us[i].push_back((now_s() - t) * 1e6);
+            }
+        }
+        for (size_t i=0; i<steps.size(); ++i)
+            cout << fixed << setprecision(1)
+                 << "[bench] op=phase_transition kind=" << steps[i].first
+                 << " reps=" << o.reps*4
+                 << " us_median=" << median(us[i])
+                 << " us_max=" << *max_element(us[i].begin(), us[i].end()) << "\n";
+    }
+}
+
+// ---------- CLI ----------
+static void print_bench_help(){
+    cerr <<
+R"(hpc_phase_sim_bench — micro-benchmarks for hpc_phase_sim engines
+
+Usage:
+  hpc_phase_sim_bench [--reps=N] [--max-size=SIZE] [--cpu-duration=TIME] [--only=op[,op...]]
+
+Ops: commit_pages free_bytes run_cpu logger_sample phase_transition
+Output (stdout): [bench] op=<op> key=value ...
+)";
+}
+
+int main(int argc, char** argv){
+    signal(SIGINT, on_sigint);
+    BenchOpts o;
+    try {
+        for (int i=1;i<argc;++i){
+            string arg = argv[i];
+            if (arg=="--help"||arg=="-h"){ print_bench_help(); return 0; }
+            else if (arg.rfind("--reps=",0)==0) o.reps = std::max(1, stoi(arg.substr(7)));
+            else if (arg.rfind("--max-size=",0)==0) o.max_size = parse_size_bytes(arg.substr(11));
+            else if (arg.rfind("--cpu-duration=",0)==0) o.cpu_duration_s = parse_duration_seconds(arg.substr(15));
+            else if (arg.rfind("--only=",0)==0) o.only = arg.substr(7);
+            else { cerr<<"Unknown arg: "<<arg<<"\n"; print_bench_help(); return 1; }
+        }
+
+        char host[256] = {0};
+        gethostname(host, sizeof(host)-1);
+        cout << "[bench] op=host hostname=" << host
+             << " cpus=" << thread::hardware_concurrency()
+             << " page_size=" << sysconf(_SC_PAGESIZE) << "\n";
+
+        if (want(o, "commit_pages"))     bench_commit_pages(o);
+        if (want(o, "free_bytes"))       bench_free_bytes(o);
+        if (want(o, "run_cpu"))          bench_run_cpu(o);
+        if (want(o, "logger_sample"))    bench_logger(o);
+        if (want(o, "phase_transition")) bench_phase_transition(o);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\n"; return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+// metrics_to_columnar.cpp
+// Streaming converter: hpc_phase_sim / NAS logs -> columnar files.
+// Scans logs for "[metrics] name=... elapsed_s=... alloc_bytes=... VmRSS_kib=..."
+// lines and "== Phase N ==" events, and writes one directory per log with
+// fixed-width little-endian arrays that can be memory-mapped directly
+// (e.g. numpy.memmap(path, dtype='<f8')).
+//
+// Build: g++ -O2 -std=c++17 metrics_to_columnar.cpp -o metrics_to_columnar
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// ---------- SIMD scanning ----------
+// First occurrence of byte c in [p, end), or end. 16 bytes per step with SSE2.
+static const char* find_byte(const char* p, const char* end, char c){
+#if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) return p + __builtin_ctz((unsigned)mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != c) ++p;
+    return p;
+}
+
+// True if [p, end) starts with the literal key (len <= 16 compared in one shot).
+static bool starts_with(const char* p, const char* end, const char* key, size_t len){
+    if ((size_t)(end - p) < len) return false;
+#if defined(__SSE2__)
+    if (len <= 16 && end - p >= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        char kb[16] = {0}; memcpy(kb, key, len);
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kb));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+        unsigned want = (len == 16) ? 0xFFFFu : ((1u << len) - 1u);
+        return (mask & want) == want;
+    }
+#endif
+    return memcmp(p, key, len) == 0;
+}
+
+static uint64_t parse_u64(const char* p, const char* end){
+    uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9') { v = v*10 + (uint64_t)(*p - '0'); ++p; }
+    return v;
+}
+
+static double parse_f64(const char* p, const char* end){
+    // Values are short ("123.4"); strtod on a bounded copy keeps it exact.
+    char tmp[64]; size_t n = std::min((size_t)(end - p), sizeof(tmp) - 1);
+    memcpy(tmp, p, n); tmp[n] = 0;
+    return strtod(tmp, nullptr);
+}
+
+// ---------- columnar output ----------
+enum PhaseKind : uint32_t { PK_UNKNOWN=0, PK_MEM=1, PK_CPU=2, PK_SLEEP=3 };
+
+#pragma pack(push, 1)
+struct PhaseEvent {          // 40 bytes, see meta.txt for the numpy dtype
+    uint32_t phase;          // 1-based phase index from "== Phase N =="
+    uint32_t kind;           // PhaseKind
+    uint64_t first_row;      // index of the first metrics sample at/after the phase start
+    int64_t  value;          // MEM: bytes (signed for deltas), CPU: threads
+    double   util;           // CPU util, else 0
+    double   duration_s;     // CPU/SLEEP duration, else 0
+};
+#pragma pack(pop)
+
+struct Columns {
+    vector<double>   elapsed_s;
+    vector<uint64_t> alloc_bytes;
+    vector<uint64_t> vmrss_kib;
+    vector<uint32_t> name_id;
+    vector<string>   names;
+    unordered_map<string,uint32_t> name_index;
+    vector<PhaseEvent> phases;
+};
+
+static const char kMetricsTag[] = "[metrics]";
+static const char kPhaseTag[]   = "== Phase ";
+
+static void parse_metrics_line(const char* p, const char* end, Columns& c){
+    double elapsed = 0.0; uint64_t alloc = 0, rss = 0; uint32_t nid = 0;
+    p += sizeof(kMetricsTag) - 1;
+    while (p < end) {
+        while (p < end && *p == ' ') ++p;
+        const char* tok_end = find_byte(p, end, ' ');
+        const char* eq = find_byte(p, tok_end, '=');
+        if (eq < tok_end) {
+            const char* v = eq + 1;
+            size_t klen = (size_t)(eq - p);
+            if (klen == 4 && starts_with(p, end, "name", 4)) {
+                string nm(v, tok_end);
+                auto it = c.name_index.find(nm);
+                if (it == c.name_index.end()) {
+                    it = c.name_index.emplace(nm, (uint32_t)c.names.size()).first;
+                    c.names.push_back(nm);
+                }
+                nid = it->second;
+            } else if (klen == 9 && starts_with(p, end, "elapsed_s", 9)) {
+                elapsed = parse_f64(v, tok_end);
+            } else if (klen == 11 && starts_with(p, end, "alloc_bytes", 11)) {
+                alloc = parse_u64(v, tok_end);
+            } else if (klen == 9 && starts_with(p, end, "VmRSS_kib", 9)) {
+                rss = parse_u64(v, tok_end);
+            }
+        }
+        p = tok_end;
+    }
+    c.elapsed_s.push_back(elapsed);
+    c.alloc_bytes.push_back(alloc);
+    c.vmrss_kib.push_back(rss);
+    c.name_id.push_back(nid);
+}
+
+// "MEM: abs=N bytes" / "MEM: +=N bytes" / "CPU: threads=.. util=.. duration=..s" / "SLEEP: duration=..s"
+// Returns false for any other line (e.g. PACER:, NUMA:), which is skipped.
+static bool parse_phase_detail(const char* p, const char* end, PhaseEvent& e){
+    auto field = [&](const char* key) -> const char* {
+        size_t len = strlen(key);
+        for (const char* q = p; q + len <= end; ++q) if (memcmp(q, key, len) == 0) return q + len;
+        return nullptr;
+    };
+    if (starts_with(p, end, "MEM:", 4)) {
+        e.kind = PK_MEM;
+        if (const char* v = field("abs="))     e.value = (int64_t)parse_u64(v, end);
+        else if (const char* v = field("+="))  e.value = (int64_t)parse_u64(v, end);
+        else if (const char* v = field("-="))  e.value = -(int64_t)parse_u64(v, end);
+    } else if (starts_with(p, end, "CPU:", 4)) {
+        e.kind = PK_CPU;
+        if (const char* v = field("threads="))  e.value = (int64_t)parse_u64(v, end);
+        if (const char* v = field("util="))     e.util = parse_f64(v, find_byte(v, end, ' '));
+        if (const char* v = field("duration=")) e.duration_s = parse_f64(v, find_byte(v, end, 's'));
+    } else if (starts_with(p, end, "SLEEP:", 6)) {
+        e.kind = PK_SLEEP;
+        if (const char* v = field("duration=")) e.duration_s = parse_f64(v, find_byte(v, end, 's'));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void scan_stream(istream& in, Columns& c){
+    const size_t block = (size_t)1 << 20;
+    vector<char> buf(2 * block);              // carry (<= block) + one read
+    size_t carry = 0;
+    bool expect_detail = false;
+    for (;;) {
+        in.read(buf.data() + carry, (streamsize)block);
+        size_t got = (size_t)in.gcount();
+        size_t avail = carry + got;
+        bool eof = (got == 0);
+        const char* p = buf.data();
+        const char* end = p + avail;
+        for (;;) {
+            const char* nl = find_byte(p, end, '\n');
+            if (nl == end && !eof) break;             // partial line: keep for next block
+            const char* le = nl;
+            if (le > p && le[-1] == '\r') --le;
+            if (starts_with(p, le, kMetricsTag, sizeof(kMetricsTag) - 1)) {
+                parse_metrics_line(p, le, c);
+            } else if (starts_with(p, le, kPhaseTag, sizeof(kPhaseTag) - 1)) {
+                PhaseEvent e{};
+                e.phase = (uint32_t)parse_u64(p + sizeof(kPhaseTag) - 1, le);
+                e.first_row = c.elapsed_s.size();
+                c.phases.push_back(e);
+                expect_detail = true;
+            } else if (expect_detail && le > p) {
+                // The first MEM:/CPU:/SLEEP: line of the phase; other phase
+                // types never match and stay kind=unknown.
+                expect_detail = !parse_phase_detail(p, le, c.phases.back());
+            }
+            if (nl == end) { p = end; break; }
+            p = nl + 1;
+        }
+        carry = (size_t)(end - p);
+        if (eof) break;
+        if (carry > block) { cerr << "Line longer than " << block << " bytes, truncating\n"; carry = 0; continue; }
+        memmove(buf.data(), p, carry);
+    }
+}
+
+template <class T>
+static void write_column(const fs::path& path, const vector<T>& v){
+    ofstream f(path, ios::binary | ios::trunc);
+    if (!f) throw runtime_error("Cannot write " + path.string());
+    f.write(reinterpret_cast<const char*>(v.data()), (streamsize)(v.size() * sizeof(T)));
+}
+
+static void write_columns(const fs::path& dir, const Columns& c){
+    fs::create_directories(dir);
+    write_column(dir / "elapsed_s.f64",   c.elapsed_s);
+    write_column(dir / "alloc_bytes.u64", c.alloc_bytes);
+    write_column(dir / "vmrss_kib.u64",   c.vmrss_kib);
+    write_column(dir / "name_id.u32",     c.name_id);
+    write_column(dir / "phases.bin",      c.phases);
+    { ofstream f(dir / "names.txt", ios::trunc); for (auto& n : c.names) f << n << "\n"; }
+    ofstream m(dir / "meta.txt", ios::trunc);
+    m << "rows=" << c.elapsed_s.size() << "\n"
+      << "phases=" << c.phases.size() << "\n"
+      << "elapsed_s.f64=<f8\n"
+      << "alloc_bytes.u64=<u8\n"
+      << "vmrss_kib.u64=<u8\n"
+      << "name_id.u32=<u4 (index into names.txt)\n"
+      << "phases.bin=[('phase','<u4'),('kind','<u4'),('first_row','<u8'),"
+         "('value','<i8'),('util','<f8'),('duration_s','<f8')]\n"
+      << "kind: 0=unknown 1=mem 2=cpu 3=sleep\n";
+}
+
+// ---------- CLI ----------
+static void print_help(){
+    cerr <<
+R"(metrics_to_columnar — convert [metrics] logs to memory-mappable columns
+
+Usage:
+  metrics_to_columnar --out=DIR <file.log|dir> [<file.log|dir>...]
+
+For each log, writes DIR/<parent>/<stem>/ with:
+  elapsed_s.f64 alloc_bytes.u64 vmrss_kib.u64 name_id.u32   (one entry per sample)
+  phases.bin   (phase event table; record layout in meta.txt)
+  names.txt meta.txt
+Directories are scanned (non-recursively) for *.log files. Use '-' to read stdin.
+)";
+}
+
+int main(int argc, char** argv){
+    string out_dir;
+    vector<fs::path> inputs;
+    for (int i=1;i<argc;++i){
+        string arg = argv[i];
+        if (arg=="--help"||arg=="-h"){ print_help(); return 0; }
+        else if (arg.rfind("--out=",0)==0) out_dir = arg.substr(6);
+        else if (arg=="-") inputs.emplace_back("-");
+        else if (fs::is_directory(arg)) {
+            vector<fs::path> logs;
+            for (auto& e : fs::directory_iterator(arg))
+                if (e.is_regular_file() && e.path().extension()==".log") logs.push_back(e.path());
+            sort(logs.begin(), logs.end());
+            inputs.insert(inputs.end(), logs.begin(), logs.end());
+        } else if (fs::is_regular_file(arg)) inputs.emplace_back(arg);
+        else { cerr<<"Unknown arg or missing file: "<<arg<<"\n"; print_help(); return 1; }
+    }
+    if (out_dir.empty() || inputs.empty()){ print_help(); return 1; }
+
+    try {
+        for (auto& in : inputs){
+            Columns c;
+            fs::path dest;
+            if (in == "-") { scan_stream(cin, c); dest = fs::path(out_dir) / "stdin"; }
+            else {
+                ifstream f(in, ios::binary);
+                if (!f) { cerr<<"Cannot open "<<in<<"\n"; return 1; }
+                scan_stream(f, c);
+                dest = fs::path(out_dir) / in.parent_path().filename() / in.stem();
+            }
+            write_columns(dest, c);
+            cerr << in.string() << ": rows=" << c.elapsed_s.size()
+                 << " phases=" << c.phases.size() << " -> " << dest.string() << "\n";
+        }
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\n"; return 1;
+    }
+    return 0;
+}